@@ -34,6 +34,19 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Fishduino.h"
 
 
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+Fishduino *volatile Fishduino::s_analog;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
 //---------------------------------------------------------------------------
 // Initialize
 bool                                  // Returns True=success False=failure
@@ -42,12 +55,24 @@ Fishduino::Reset(
 {
   bool result = true;
 
+#ifdef FISHDUINO_STATS
+  unsigned long start = micros();
+#endif
+
   SetNumInterfaces(num_interfaces);
 
   // Initialize pins
   for (unsigned u = 0; u < NumPins; u++)
   {
     pinMode(m_pin[u], u == DATACOUNTIN ? INPUT : OUTPUT);
+
+    // Make sure the output pins aren't in PWM mode; digitalWrite takes
+    // care of that. After this, the pins are accessed through the port
+    // registers directly.
+    if (u != DATACOUNTIN)
+    {
+      digitalWrite(m_pin[u], LOW);
+    }
   }
 
   // Reset all outputs
@@ -67,14 +92,14 @@ Fishduino::Reset(
   unsigned long starttime = millis();
 
   // Un-trigger the analog inputs
-  digitalWrite(m_pin[TRIGGERX], HIGH);
-  digitalWrite(m_pin[TRIGGERY], HIGH);
+  PinWrite(TRIGGERX, HIGH);
+  PinWrite(TRIGGERY, HIGH);
 
   // Wait until the pin goes HIGH, meaning all outputs are LOW.
-  while (!digitalRead(m_pin[DATACOUNTIN]))
+  while (!PinRead(DATACOUNTIN))
   {
-    digitalWrite(m_pin[CLOCK], LOW);
-    digitalWrite(m_pin[CLOCK], HIGH);
+    PinWrite(CLOCK, LOW);
+    PinWrite(CLOCK, HIGH);
 
     // Check for time-out. If this happens, something is wrong with the
     // interface or it is connected wrong.
@@ -85,46 +110,123 @@ Fishduino::Reset(
     }
   }
 
+#ifdef FISHDUINO_STATS
+  if (!result)
+  {
+    m_stats.resettimeouts++;
+  }
+
+  StatsTime(m_stats.reset, start);
+#endif
+
   return result;
 }
 
 
 //---------------------------------------------------------------------------
-// Set the outputs of the interfaces
-void Fishduino::SetOutputs(
-  const byte *values)                 // 1 byte per interface (NULL=reset)
+// Find out how many interfaces are connected
+byte                                  // Returns min num. of interfaces
+Fishduino::Probe(
+  bool update)                        // True=increase num. of interfaces
 {
-  digitalWrite(m_pin[LOADOUT], LOW);
+  byte inputs[MaxInterfaces];
+  byte num = m_num_interfaces;
+  byte result = 0;
 
-  // Note: the following pointer is invalid is NULL is passed.
-  // That's okay, we won't dereference it in that case anyway.
-  const byte *p = values + m_num_interfaces;
+  // Read all possible interfaces. This clocks the output shift registers
+  // too, but LOAD OUT stays LOW so the outputs don't change.
+  m_num_interfaces = MaxInterfaces;
+  GetInputs(inputs);
+  m_num_interfaces = num;
 
-  // Send enough output bits for the known number of interfaces.
-  // If NULL is passed, send the maximum number of bits. This is sort of a
-  // security feature so that "unclaimed" interfaces are cleared too.
-  // Note, however, that if you call the function with a non-NULL parameter,
-  // any unclaimed interfaces will get bogus output data.
-  for (unsigned v = 0; v < (values ? m_num_interfaces : MaxInterfaces); v++)
+  for (byte v = 0; v < MaxInterfaces; v++)
   {
-    // Output bits
-    byte b = values ? *--p : 0;
-
-    for (unsigned u = 0; u < 8; u++, b <<= 1)
+    if (inputs[v])
     {
-      digitalWrite(m_pin[CLOCK], LOW);
-      digitalWrite(m_pin[DATAOUT], (b & 0x80) != 0);
-      digitalWrite(m_pin[CLOCK], HIGH);
+      result = v + 1;
     }
   }
 
-  digitalWrite(m_pin[LOADOUT], HIGH);
-  digitalWrite(m_pin[LOADOUT], LOW);
+  if ((update) && (result > m_num_interfaces))
+  {
+    m_num_interfaces = result;
+  }
 
-  // At this point:
-  // - CLOCK is HIGH
-  // - DATA OUT is LOW
-  // - LOAD OUT is LOW
+  return result;
+}
+
+
+//---------------------------------------------------------------------------
+// Use SPI hardware for shifting
+bool                                  // Returns True=SPI in use
+Fishduino::UseSPI(
+  bool enable)                        // True=use SPI, false=bit-bang
+{
+  m_spi = false;
+
+#ifdef FISHDUINO_SPI
+  if ((enable)
+    && (m_pin[DATAOUT] == PIN_SPI_MOSI)
+    && (m_pin[CLOCK] == PIN_SPI_SCK)
+    && (m_pin[DATACOUNTIN] == PIN_SPI_MISO))
+  {
+    pinMode(PIN_SPI_SS, OUTPUT);
+
+    // Make sure the clock is HIGH before the SPI port takes over the pin
+    PinWrite(CLOCK, HIGH);
+
+    m_spi = true;
+  }
+
+  SPCR = 0;
+#else
+  (void)enable;
+#endif
+
+  return m_spi;
+}
+
+
+//---------------------------------------------------------------------------
+// Use a function with compile-time pin numbers for bit-banging
+bool                                  // Returns True=function in use
+Fishduino::UseShiftFunc(
+  ShiftFunc func,                     // Function to use, NULL=pin array
+  byte pin_datacountin,               // Pins that the function uses
+  byte pin_dataout,
+  byte pin_clock,
+  byte pin_loadout,
+  byte pin_loadin)
+{
+  if ((m_pin[DATACOUNTIN] != pin_datacountin)
+    || (m_pin[DATAOUT] != pin_dataout)
+    || (m_pin[CLOCK] != pin_clock)
+    || (m_pin[LOADOUT] != pin_loadout)
+    || (m_pin[LOADIN] != pin_loadin))
+  {
+    func = NULL;
+  }
+
+  // The pointer may be used by a background refresh
+  noInterrupts();
+  m_shiftfunc = func;
+  interrupts();
+
+  return func != NULL;
+}
+
+
+//---------------------------------------------------------------------------
+// Set the outputs of the interfaces
+void Fishduino::SetOutputs(
+  const byte *values)                 // 1 byte per interface (NULL=reset)
+{
+  // Send enough output bits for the known number of interfaces.
+  // If NULL is passed, send the maximum number of bits. This is sort of a
+  // security feature so that "unclaimed" interfaces are cleared too.
+  // Note, however, that if you call the function with a non-NULL parameter,
+  // any unclaimed interfaces will get bogus output data.
+  Shift(values ? m_num_interfaces : MaxInterfaces, values, NULL);
 }
 
 
@@ -133,11 +235,36 @@ void Fishduino::SetOutputs(
 void Fishduino::GetInputs(
   byte *values)                       // One byte per interface
 {
+#ifdef FISHDUINO_STATS
+  unsigned long start = micros();
+#endif
+
   // Switch the input chip to parallel mode and clock it to load the inputs
-  digitalWrite(m_pin[LOADIN], HIGH);
-  digitalWrite(m_pin[CLOCK], LOW);
-  digitalWrite(m_pin[CLOCK], HIGH);
-  digitalWrite(m_pin[LOADIN], LOW);
+  PinWrite(LOADIN, HIGH);
+  PinWrite(CLOCK, LOW);
+  PinWrite(CLOCK, HIGH);
+  PinWrite(LOADIN, LOW);
+
+#ifdef FISHDUINO_SPI
+  if ((m_spi) && (values))
+  {
+    SPCR = FISHDUINO_SPCR;
+
+    // Our input is inverted with respect to the shift register
+    for (unsigned v = 0; v < m_num_interfaces; v++)
+    {
+      values[v] = ~SpiTransfer(0);
+    }
+
+    SPCR = 0;
+
+#ifdef FISHDUINO_STATS
+    StatsTime(m_stats.refresh, start);
+#endif
+
+    return;
+  }
+#endif
 
   if (values)
   {
@@ -151,49 +278,258 @@ void Fishduino::GetInputs(
       {
         data <<= 1;
 
-        data |= (digitalRead(m_pin[DATACOUNTIN]) == LOW);
+        data |= !PinRead(DATACOUNTIN);
 
-        digitalWrite(m_pin[CLOCK], LOW);
-        digitalWrite(m_pin[CLOCK], HIGH);
+        PinWrite(CLOCK, LOW);
+        PinWrite(CLOCK, HIGH);
       }
 
       values[v] = data;
     }
   }
 
+#ifdef FISHDUINO_STATS
+  StatsTime(m_stats.refresh, start);
+#endif
+
   // At this point:
   // - CLOCK is high
   // - LOAD IN is LOW
 }
 
 
+//---------------------------------------------------------------------------
+// Set the outputs and read the inputs at the same time
+void Fishduino::Exchange(
+  const byte *outvalues,              // 1 byte per interface (NULL=reset)
+  byte *invalues)                     // 1 byte per interface (or NULL)
+{
+  byte buf[MaxInterfaces];
+
+  if (!outvalues)
+  {
+    // Same as SetOutputs: if NULL is passed, clear all possible interfaces.
+    // Only the inputs of the configured interfaces are returned.
+    Shift(MaxInterfaces, NULL, invalues ? buf : NULL);
+
+    if (invalues)
+    {
+      memcpy(invalues, buf, m_num_interfaces);
+    }
+  }
+  else
+  {
+    // If the input and output arrays are the same, we need to save the
+    // output bytes before we overwrite them with the inputs.
+    if (outvalues == invalues)
+    {
+      memcpy(buf, outvalues, m_num_interfaces);
+      outvalues = buf;
+    }
+
+    Shift(m_num_interfaces, outvalues, invalues);
+  }
+}
+
+
 //---------------------------------------------------------------------------
 // Get an analog input
 unsigned                              // Returns time (us), see above
 Fishduino::GetAnalog(
   byte index)                         // 0=X, 1=Y
 {
-  byte trigger = m_pin[index ? TRIGGERY : TRIGGERX];
+  byte trigger = index ? TRIGGERY : TRIGGERX;
 
-  digitalWrite(trigger, LOW);
-  digitalWrite(trigger, HIGH);
+  PinWrite(trigger, LOW);
+  PinWrite(trigger, HIGH);
 
   unsigned long n;
   unsigned long t = 0;
 
-  for (n = micros(); digitalRead(m_pin[DATACOUNTIN]) == LOW; )
+  for (n = micros(); !PinRead(DATACOUNTIN); )
   {
     t = micros() - n;
     if (t > AnalogTimeout)
     {
+#ifdef FISHDUINO_STATS
+      m_stats.analogtimeouts++;
+#endif
       break;
     }
   }
 
+#ifdef FISHDUINO_STATS
+  StatsTime(m_stats.analog, n);
+#endif
+
   return t;
 }
 
 
+//---------------------------------------------------------------------------
+// Start reading an analog input in the background
+void Fishduino::StartAnalog(
+  byte index)                         // 0=X, 1=Y
+{
+  byte trigger = index ? TRIGGERY : TRIGGERX;
+
+  // Abandon any measurement in progress
+  if (s_analog == this)
+  {
+    detachInterrupt(digitalPinToInterrupt(m_pin[DATACOUNTIN]));
+    s_analog = NULL;
+  }
+
+  m_analogstate = AnalogIdle;
+
+#ifdef FISHDUINO_TIMER1
+  // Let Timer1 run freely at the CPU clock frequency. At 16MHz, it wraps
+  // around every 4096 microseconds, which is more than the timeout.
+  // If the input capture unit is used, capture the rising edge.
+  TCCR1A = 0;
+  TCCR1B = _BV(ICES1) | _BV(CS10);
+
+#ifdef FISHDUINO_ICP1_PIN
+  if (m_pin[DATACOUNTIN] == FISHDUINO_ICP1_PIN)
+  {
+    TIFR1 = _BV(ICF1);
+  }
+  else
+#endif
+#endif
+  if (digitalPinToInterrupt(m_pin[DATACOUNTIN]) != NOT_AN_INTERRUPT)
+  {
+    // If the interrupt flag was set by an earlier edge, the handler is
+    // called right away, but it ignores the edge because the state is
+    // still idle.
+    s_analog = this;
+    attachInterrupt(digitalPinToInterrupt(m_pin[DATACOUNTIN]), AnalogIsr, RISING);
+  }
+
+  noInterrupts();
+
+  PinWrite(trigger, LOW);
+  PinWrite(trigger, HIGH);
+
+#ifdef FISHDUINO_TIMER1
+  m_analogstart = TCNT1;
+#endif
+  m_analogstartus = micros();
+  m_analogstate = AnalogBusy;
+
+  interrupts();
+}
+
+
+//---------------------------------------------------------------------------
+// Check if an analog measurement is done
+bool                                  // Returns true=result available
+Fishduino::IsAnalogReady()
+{
+  if (m_analogstate == AnalogBusy)
+  {
+#ifdef FISHDUINO_TIMER1
+#ifdef FISHDUINO_ICP1_PIN
+    if (m_pin[DATACOUNTIN] == FISHDUINO_ICP1_PIN)
+    {
+      if (TIFR1 & _BV(ICF1))
+      {
+        m_analogticks = ICR1 - m_analogstart;
+        m_analogstate = AnalogDone;
+      }
+    }
+    else
+#endif
+    if (s_analog != this)
+    {
+      uint16_t now = TCNT1;
+
+      if (PinRead(DATACOUNTIN))
+      {
+        m_analogticks = now - m_analogstart;
+        m_analogstate = AnalogDone;
+      }
+    }
+#else
+    if (s_analog != this)
+    {
+      unsigned long now = micros();
+
+      if (PinRead(DATACOUNTIN))
+      {
+        m_analogticks = now - m_analogstartus;
+        m_analogstate = AnalogDone;
+      }
+    }
+#endif
+
+    // Check for time-out; the result is the same as for GetAnalog
+    if ((m_analogstate == AnalogBusy) && (micros() - m_analogstartus > AnalogTimeout))
+    {
+      noInterrupts();
+
+      if (m_analogstate == AnalogBusy)
+      {
+#ifdef FISHDUINO_TIMER1
+        m_analogticks = AnalogTimeout * (F_CPU / 1000000UL);
+#else
+        m_analogticks = AnalogTimeout;
+#endif
+        m_analogstate = AnalogDone;
+      }
+
+      interrupts();
+    }
+
+    if ((m_analogstate == AnalogDone) && (s_analog == this))
+    {
+      detachInterrupt(digitalPinToInterrupt(m_pin[DATACOUNTIN]));
+      s_analog = NULL;
+    }
+  }
+
+  return (m_analogstate == AnalogDone);
+}
+
+
+//---------------------------------------------------------------------------
+// Get the result of an analog measurement
+unsigned                              // Returns time, see above
+Fishduino::GetAnalogResult(
+  bool fine)                          // True=1/16us, false=us
+{
+  unsigned long result = m_analogticks;
+
+#ifdef FISHDUINO_TIMER1
+  // Convert timer ticks to 1/16 microseconds
+  result = result * 16 / (F_CPU / 1000000UL);
+#else
+  // Convert microseconds to 1/16 microseconds
+  result *= 16;
+#endif
+
+  return (unsigned)(fine ? result : result / 16);
+}
+
+
+//---------------------------------------------------------------------------
+// External interrupt handler for analog measurements
+void Fishduino::AnalogIsr()
+{
+  Fishduino *p = s_analog;
+
+  if ((p) && (p->m_analogstate == AnalogBusy))
+  {
+#ifdef FISHDUINO_TIMER1
+    p->m_analogticks = TCNT1 - p->m_analogstart;
+#else
+    p->m_analogticks = micros() - p->m_analogstartus;
+#endif
+    p->m_analogstate = AnalogDone;
+  }
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 // END
 /////////////////////////////////////////////////////////////////////////////
@@ -96,6 +96,51 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <Arduino.h>
 
 
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Hardware SPI is supported on AVR processors that have an SPI port
+#if defined(SPDR) && defined(PIN_SPI_MOSI)
+#define FISHDUINO_SPI
+#endif
+
+// Timer1 is used to measure analog inputs in the background
+#if defined(TCNT1) && defined(ICR1)
+#define FISHDUINO_TIMER1
+#endif
+
+// Arduino pin that's connected to the input capture unit of Timer1
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) \
+ || defined(__AVR_ATmega168P__) || defined(__AVR_ATmega168__)
+#define FISHDUINO_ICP1_PIN 8
+#elif defined(__AVR_ATmega32U4__)
+#define FISHDUINO_ICP1_PIN 4
+#endif
+
+// Define FISHDUINO_STATS to make the library keep statistics about how
+// often and how long it talks to the interface(s); see GetStats. It's off
+// by default, because measuring the time of each call costs a few
+// microseconds. The macro changes the layout of the classes, so it has to be
+// the same for all source files: uncomment it here, or define it with a
+// compiler option.
+//#define FISHDUINO_STATS
+
+#ifdef FISHDUINO_SPI
+// SPI control register value while shifting:
+// - Master mode, MSB first (same order as the bit-banging code)
+// - Mode 3: the clock idles HIGH, which is the same state in which the
+//   bit-banging code leaves it, so switching the SPI port on and off doesn't
+//   generate any rising edges. The data is shifted out on the falling edge
+//   and sampled on the rising edge, just like the bit-banging code does it.
+// - Clock is F_CPU/16 (1MHz on a 16MHz Arduino). The 4000-series chips in
+//   the interface can't go much faster at 5V, and there's a ribbon cable
+//   in between.
+#define FISHDUINO_SPCR (_BV(SPE) | _BV(MSTR) | _BV(CPOL) | _BV(CPHA) | _BV(SPR0))
+#endif
+
+
 /////////////////////////////////////////////////////////////////////////////
 // FISHDUINO
 /////////////////////////////////////////////////////////////////////////////
@@ -111,6 +156,38 @@ public:
     MaxInterfaces = 4,                  // Max number of interfaces supported
   };
 
+  // Function that shifts the bits instead of the pin array, see
+  // UseShiftFunc. The parameters are the same as for ShiftBits.
+  typedef void (*ShiftFunc)(byte num, const byte *outvalues, byte *invalues);
+
+  // The multi-chain driver shifts the data of several chains with the pins
+  // and registers of each chain.
+  friend class FishduinoMulti;
+
+#ifdef FISHDUINO_STATS
+  // Duration statistics of one kind of operation, see GetStats
+  struct StatsTiming
+  {
+    unsigned long   count;              // Number of calls
+    unsigned long   total;              // Total duration (us)
+    unsigned long   min;                // Shortest duration (us)
+    unsigned long   max;                // Longest duration (us)
+    unsigned long   mean;               // Average duration (us)
+  };
+
+  // Statistics, see GetStats
+  struct Stats
+  {
+    StatsTiming     refresh;            // Shifting data to/from interfaces
+    StatsTiming     analog;             // GetAnalog
+    StatsTiming     reset;              // Reset
+    unsigned long   analogtimeouts;     // GetAnalog timed out
+    unsigned long   resettimeouts;      // Reset failed
+    unsigned long   longestgap;         // Longest time between outputs (us)
+    unsigned long   debounceheld;       // Input changes held by debouncer
+  };
+#endif
+
 protected:
   // These values are used to index the pin array
    enum 
@@ -134,6 +211,16 @@ protected:
   // This is initialized at construction time and not changed afterwards.
   byte m_pin[NumPins];
 
+#ifdef __AVR__
+  // Port register and bit mask for each pin in the array above.
+  // These are looked up at construction time, so that the bit-banging code
+  // doesn't have to go through the pin-to-port tables of digitalWrite and
+  // digitalRead for every clock pulse. For the input pin, the register is
+  // the PINx register; for the output pins it's the PORTx register.
+  volatile uint8_t *m_reg[NumPins];
+  uint8_t m_bit[NumPins];
+#endif
+
 protected:
   // Number of interfaces configured
   //
@@ -145,6 +232,42 @@ protected:
   // get their output pins set to bogus values.
   byte m_num_interfaces;
 
+protected:
+  // True if the outputs and inputs are shifted with the SPI hardware
+  // instead of by bit-banging. See UseSPI.
+  bool m_spi;
+
+protected:
+  // Function with compile-time pin numbers that does the bit-banging
+  // instead of the pin array, or NULL. See UseShiftFunc.
+  ShiftFunc m_shiftfunc;
+
+protected:
+  // States of the background analog measurement
+  enum
+  {
+    AnalogIdle,                         // No measurement started
+    AnalogBusy,                         // Waiting for the timer
+    AnalogDone,                         // Result available
+  };
+
+  // Background analog measurement, see StartAnalog
+  volatile byte m_analogstate;          // See enum above
+  volatile uint16_t m_analogticks;      // Result in timer ticks
+  uint16_t m_analogstart;               // Timer ticks at trigger time
+  unsigned long m_analogstartus;        // Time of trigger (micros)
+
+  // Object that's measuring an analog input using an external interrupt
+  static Fishduino *volatile s_analog;
+
+#ifdef FISHDUINO_STATS
+protected:
+  // Statistics, see GetStats. The mean durations are only calculated when
+  // the statistics are retrieved.
+  Stats m_stats;
+  unsigned long m_statslatched;         // Time of last output latch (micros)
+#endif
+
 private:
   //-------------------------------------------------------------------------
   // Private function called during construction
@@ -167,10 +290,303 @@ private:
     m_pin[LOADOUT]      = pin_loadout;
     m_pin[LOADIN]       = pin_loadin;
 
+#ifdef __AVR__
+    // Look up the registers and bit masks for each pin
+    for (unsigned u = 0; u < NumPins; u++)
+    {
+      uint8_t port = digitalPinToPort(m_pin[u]);
+
+      m_reg[u] = (u == DATACOUNTIN) ? portInputRegister(port) : portOutputRegister(port);
+      m_bit[u] = digitalPinToBitMask(m_pin[u]);
+    }
+#endif
+
+    // Use bit-banging until the application tells us otherwise
+    m_spi = false;
+    m_shiftfunc = NULL;
+
+    m_analogstate = AnalogIdle;
+
+#ifdef FISHDUINO_STATS
+    m_statslatched = micros();
+    ResetStats();
+#endif
+
     // Reset outputs, initialize input
     Reset(num_interfaces);
   }
 
+protected:
+  //-------------------------------------------------------------------------
+  // Set one of the output lines to the interface
+  //
+  // On AVR, this writes the port register directly. Interrupts are disabled
+  // during the read-modify-write, the same way digitalWrite does it, in case
+  // an interrupt handler changes another pin on the same port.
+  void PinWrite(
+    byte index,                         // Index into pin array
+    bool value)                         // True=HIGH, false=LOW
+  {
+#ifdef __AVR__
+    uint8_t oldsreg = SREG;
+
+    cli();
+
+    if (value)
+    {
+      *m_reg[index] |= m_bit[index];
+    }
+    else
+    {
+      *m_reg[index] &= ~m_bit[index];
+    }
+
+    SREG = oldsreg;
+#else
+    digitalWrite(m_pin[index], value ? HIGH : LOW);
+#endif
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Read one of the input lines from the interface
+  bool                                  // Returns true=HIGH, false=LOW
+  PinRead(
+    byte index)                         // Index into pin array
+  {
+#ifdef __AVR__
+    return (*m_reg[index] & m_bit[index]) != 0;
+#else
+    return digitalRead(m_pin[index]) != LOW;
+#endif
+  }
+
+#ifdef FISHDUINO_SPI
+protected:
+  //-------------------------------------------------------------------------
+  // Shift a byte out and in with the SPI hardware
+  static byte                           // Returns byte shifted in
+  SpiTransfer(
+    byte value)                         // Byte to shift out
+  {
+    SPDR = value;
+
+    while (!(SPSR & _BV(SPIF)))
+    {
+      // Nothing
+    }
+
+    return SPDR;
+  }
+#endif
+
+#ifdef FISHDUINO_STATS
+protected:
+  //-------------------------------------------------------------------------
+  // Add the duration of an operation to the statistics
+  void
+  StatsTime(
+    StatsTiming &timing,                // Statistics to update
+    unsigned long start)                // micros() at start of operation
+  {
+    unsigned long duration = micros() - start;
+
+    timing.count++;
+    timing.total += duration;
+
+    if (duration < timing.min)
+    {
+      timing.min = duration;
+    }
+
+    if (duration > timing.max)
+    {
+      timing.max = duration;
+    }
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Keep track of the time between output latches
+  void
+  StatsLatched()
+  {
+    unsigned long now = micros();
+    unsigned long gap = now - m_statslatched;
+
+    if (gap > m_stats.longestgap)
+    {
+      m_stats.longestgap = gap;
+    }
+
+    m_statslatched = now;
+  }
+#endif
+
+protected:
+  //-------------------------------------------------------------------------
+  // Shift output bytes out and (optionally) input bytes in
+  //
+  // This does the work for SetOutputs and Exchange; see ShiftBits.
+  void
+  Shift(
+    byte num,                           // Number of interfaces, at least 1
+    const byte *outvalues,              // num bytes (NULL=all off)
+    byte *invalues)                     // num bytes (NULL=don't read)
+  {
+#ifdef FISHDUINO_STATS
+    unsigned long start = micros();
+
+    ShiftBits(num, outvalues, invalues);
+
+    StatsLatched();
+    StatsTime(m_stats.refresh, start);
+#else
+    ShiftBits(num, outvalues, invalues);
+#endif
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Shift output bytes out and (optionally) input bytes in
+  //
+  // See Exchange for how this works. The number of interfaces is a
+  // parameter instead of the member variable, so that when it's called with
+  // a constant (see FishduinoMgrN), the compiler knows how many times the
+  // loops run, and can unroll them.
+  //
+  // If the output array is NULL, zeroes are shifted out. If the input array
+  // is NULL, the input shift registers aren't loaded and no input bits are
+  // read, so this is safe to use while an analog input is being measured.
+  // The arrays must not overlap.
+  //
+  // The bits are shifted by the SPI hardware if it's in use, otherwise by
+  // the shift function if there is one (see UseShiftFunc), otherwise by
+  // the code below.
+  void
+  ShiftBits(
+    byte num,                           // Number of interfaces, at least 1
+    const byte *outvalues,              // num bytes (NULL=all off)
+    byte *invalues)                     // num bytes (NULL=don't read)
+  {
+    const byte *p = outvalues ? outvalues + num : NULL;
+
+    byte data = 0;
+
+#ifdef FISHDUINO_SPI
+    if (m_spi)
+    {
+      PinWrite(LOADOUT, LOW);
+
+      // The SPI hardware can only shift whole bytes, so the inputs are
+      // loaded with a separate clock pulse. This shifts one extra bit into
+      // the output shift registers, but it falls off the end of the chain
+      // when the output bytes are shifted in.
+      if (invalues)
+      {
+        PinWrite(LOADIN, HIGH);
+        PinWrite(CLOCK, LOW);
+        PinWrite(CLOCK, HIGH);
+        PinWrite(LOADIN, LOW);
+      }
+
+      SPCR = FISHDUINO_SPCR;
+
+      for (byte v = 0; v < num; v++)
+      {
+        // Our input is inverted with respect to the shift register
+        data = ~SpiTransfer(outvalues ? *--p : 0);
+
+        if (invalues)
+        {
+          invalues[v] = data;
+        }
+      }
+
+      SPCR = 0;
+
+      PinWrite(LOADOUT, HIGH);
+      PinWrite(LOADOUT, LOW);
+
+      return;
+    }
+#endif
+
+    // Let the function with compile-time pins do the bit-banging
+    if (m_shiftfunc)
+    {
+      m_shiftfunc(num, outvalues, invalues);
+      return;
+    }
+
+    PinWrite(LOADOUT, LOW);
+
+    // The first rising edge of the clock loads the inputs
+    if (invalues)
+    {
+      PinWrite(LOADIN, HIGH);
+    }
+
+    for (byte v = 0; v < num; v++)
+    {
+      byte b = outvalues ? *--p : 0;
+
+      for (byte u = 0; u < 8; u++, b <<= 1)
+      {
+        PinWrite(CLOCK, LOW);
+        PinWrite(DATAOUT, (b & 0x80) != 0);
+
+        // Read the input bit that's on the serial output of the input shift
+        // registers since the previous clock pulse. We do this while CLOCK
+        // is LOW, to give the signal enough time to settle.
+        if ((invalues) && (v | u))
+        {
+          data <<= 1;
+          data |= !PinRead(DATACOUNTIN);
+
+          // If this was the last bit of an input byte, store it
+          if (!u)
+          {
+            invalues[v - 1] = data;
+          }
+        }
+
+        PinWrite(CLOCK, HIGH);
+
+        // After the first clock pulse, switch the input shift register to
+        // serial mode
+        if ((invalues) && !(v | u))
+        {
+          PinWrite(LOADIN, LOW);
+        }
+      }
+    }
+
+    // Latch the outputs
+    PinWrite(LOADOUT, HIGH);
+    PinWrite(LOADOUT, LOW);
+
+    if (invalues)
+    {
+      // Read the last input bit
+      data <<= 1;
+      data |= !PinRead(DATACOUNTIN);
+
+      invalues[num - 1] = data;
+
+      // Shift the last input bit out, so that the serial output of the
+      // input shift register is LOW, the same as after GetInputs. Otherwise
+      // the analog inputs can't be read.
+      PinWrite(CLOCK, LOW);
+      PinWrite(CLOCK, HIGH);
+    }
+
+    // At this point:
+    // - CLOCK is HIGH
+    // - LOAD OUT is LOW
+    // - LOAD IN is LOW
+  }
+
 public:
   //-------------------------------------------------------------------------
   // Constructor
@@ -222,6 +638,56 @@ public:
     m_num_interfaces = constrain(num_interfaces, 1, MaxInterfaces);
   }
 
+public:
+  //-------------------------------------------------------------------------
+  // Use the SPI hardware to shift the outputs and inputs
+  //
+  // This only works if the interface is connected to the SPI pins of the
+  // Arduino: DATA OUT must be on MOSI, CLOCK must be on SCK and DATA/COUNT
+  // IN must be on MISO (on an Uno, that's pins 11, 13 and 12). The other
+  // pins can be anywhere. The SS pin is switched to output mode, otherwise
+  // the SPI hardware can't work as master.
+  //
+  // With SPI, a whole byte is shifted in and out by the hardware, which is
+  // many times faster than bit-banging. The SPI port is only enabled while
+  // the outputs and inputs are shifted, so other functions that pulse the
+  // clock by themselves (such as Reset) keep working. It's not possible to
+  // share the SPI port with other devices while this is enabled.
+  //
+  // The function returns false if the pins are not connected to the SPI
+  // port or the Arduino doesn't have one; in that case bit-banging stays
+  // in use.
+  bool                                  // Returns True=SPI in use
+  UseSPI(
+    bool enable = true);                // True=use SPI, false=bit-bang
+
+public:
+  //-------------------------------------------------------------------------
+  // Use a function with compile-time pin numbers for bit-banging
+  //
+  // All functions that shift data to and from the interface (including
+  // those of FishduinoMgr and the background refresh) go through ShiftBits.
+  // If a shift function is set, ShiftBits calls it instead of toggling the
+  // pins through the pin array. FishduinoFast (see FishduinoFast.h) has
+  // such a function, that uses single instructions to toggle the pins:
+  //
+  //   FishduinoMgr fishduino;
+  //   ...
+  //   FishduinoFast<>::Attach(fishduino);
+  //
+  // The function is only used if the given pins are the same as the pins
+  // that were passed to the constructor; otherwise, the function returns
+  // false and the pin array stays in use. Pass NULL to go back to the pin
+  // array. If the SPI hardware is in use (see UseSPI), it takes precedence.
+  bool                                  // Returns True=function in use
+  UseShiftFunc(
+    ShiftFunc func,                     // Function to use, NULL=pin array
+    byte pin_datacountin,               // Pins that the function uses
+    byte pin_dataout,
+    byte pin_clock,
+    byte pin_loadout,
+    byte pin_loadin);
+
 public:
   //-------------------------------------------------------------------------
   // Reset the connection to the interface
@@ -237,10 +703,37 @@ public:
   //
   // This function is called by the constructor, but it can also be called
   // when you want to return the state of the interface to a known state.
+  //
+  // The number of interfaces isn't detected automatically; see Probe.
   bool                                  // Returns True=success False=failure
   Reset(
     byte num_interfaces = 1);
 
+public:
+  //-------------------------------------------------------------------------
+  // Find out how many interfaces are connected
+  //
+  // This reads the inputs of the maximum number of interfaces, without
+  // changing any outputs, and returns the number of interfaces up to and
+  // including the last one that has at least one input turned on.
+  //
+  // Unfortunately, there's no way for the Arduino to tell the difference
+  // between an interface of which all inputs are off, and an interface that
+  // isn't there: the serial input of the input shift register of the last
+  // interface is pulled down, so it reads as inputs that are off, and
+  // nothing that's sent to the interface comes back. So the result is the
+  // minimum number of connected interfaces. For a reliable result, make
+  // sure that at least one input of the last interface is on, e.g. by
+  // holding a switch down or by using a normally-closed switch.
+  //
+  // If the update parameter is true and the probe found more interfaces
+  // than were configured, the number of interfaces is increased. This
+  // prevents the bogus outputs that happen when too few interfaces are
+  // configured. The number is never decreased.
+  byte                                  // Returns min num. of interfaces
+  Probe(
+    bool update = false);               // True=increase num. of interfaces
+
 public:
   //-------------------------------------------------------------------------
   // Set the outputs of the interfaces
@@ -293,6 +786,40 @@ public:
     GetInputs(values);
   }
 
+public:
+  //-------------------------------------------------------------------------
+  // Set the outputs and read the digital inputs in one pass
+  //
+  // This does the same as calling SetOutputs and then GetInputs, but it
+  // does it in half the number of clock pulses: the output shift registers
+  // and the input shift registers share the CLOCK line, so each clock pulse
+  // shifts an output bit in and an input bit out at the same time.
+  //
+  // The first clock pulse is used to load the input shift registers
+  // (LOAD IN is HIGH) and to shift in the first output bit. LOAD OUT stays
+  // LOW until all output bits are shifted in, so the outputs don't change
+  // until all the data is in place.
+  // One extra clock pulse at the end shifts the last input bit out, so
+  // that the analog inputs can be read afterwards.
+  //
+  // The output and input arrays are in the same format as for SetOutputs
+  // and GetInputs. It's okay to pass the same array for both.
+  void Exchange(
+    const byte *outvalues,              // 1 byte per interface (NULL=reset)
+    byte *invalues);                    // 1 byte per interface (or NULL)
+
+public:
+  //-------------------------------------------------------------------------
+  // Set number of interfaces and then exchange outputs and inputs
+  void Exchange(
+    byte num_interfaces,                // Number of interfaces
+    const byte *outvalues,              // 1 byte per interface (NULL=reset)
+    byte *invalues)                     // 1 byte per interface (or NULL)
+  {
+    SetNumInterfaces(num_interfaces);
+    Exchange(outvalues, invalues);
+  }
+
 public:
   //-------------------------------------------------------------------------
   // Get an analog input
@@ -311,6 +838,121 @@ public:
   unsigned                              // Returns time (us), see above
   GetAnalog(
     byte index);                        // 0=X, 1=Y
+
+public:
+  //-------------------------------------------------------------------------
+  // Start reading an analog input in the background
+  //
+  // This triggers the timer in the interface and returns immediately. Call
+  // IsAnalogReady to find out if the measurement is done, and then call
+  // GetAnalogResult to get the result. In the mean time, the program can
+  // do other things, except use the functions that shift data to or from
+  // the interface: the inputs share the DATA/COUNT IN line with the timers.
+  // The outputs can be set, though.
+  //
+  // On AVR, the time is measured with Timer1, running at the CPU clock
+  // frequency. This means that Timer1 can't be used for anything else
+  // (such as PWM on pins 9 and 10 of an Uno, or the Servo library) if this
+  // function is used. The end of the measurement is detected as follows:
+  // - If DATA/COUNT IN is connected to the input capture pin of Timer1 (pin
+  //   8 on an Uno), the timer hardware captures the time of the edge. This
+  //   is the most accurate method.
+  // - If DATA/COUNT IN is connected to a pin with an external interrupt
+  //   (pin 2 or 3 on an Uno), the time is captured by an interrupt handler.
+  //   The result includes the interrupt latency, which can be higher if
+  //   other interrupt handlers are running (e.g. a background refresh).
+  // - Otherwise, the pin is polled by IsAnalogReady, so the resolution
+  //   depends on how often that function is called.
+  //
+  // If a measurement is already in progress, it's abandoned.
+  void StartAnalog(
+    byte index);                        // 0=X, 1=Y
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if an analog measurement is done
+  //
+  // This also returns true if the measurement timed out.
+  bool                                  // Returns true=result available
+  IsAnalogReady();
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the result of an analog measurement
+  //
+  // The result is in microseconds, like the result of GetAnalog, or in
+  // sixteenths of a microsecond if the fine parameter is set. It's only
+  // valid after IsAnalogReady returned true.
+  unsigned                              // Returns time, see above
+  GetAnalogResult(
+    bool fine = false);                 // True=1/16us, false=us
+
+#ifdef FISHDUINO_STATS
+public:
+  //-------------------------------------------------------------------------
+  // Get the statistics
+  //
+  // The statistics are only available if FISHDUINO_STATS is defined (see
+  // above). They're kept from construction or from the last call to
+  // ResetStats:
+  // - refresh: each time data is shifted to or from the interface(s); this
+  //   includes the refreshes by the background timer and the manager.
+  // - analog: each call to GetAnalog; the timeouts are the calls where no
+  //   potentiometer was connected.
+  // - reset: each call to Reset; the timeouts are the calls that failed.
+  // - The longest gap is the longest time between two output refreshes.
+  //   If it's more than about 500ms, the outputs were turned off by the
+  //   interface for a while.
+  // - The debounce count is the number of times that FishduinoMgr held
+  //   back the change of an input, because it hadn't been stable for long
+  //   enough yet (see SetInputDebounce).
+  void
+  GetStats(
+    Stats &stats)                       // Receives statistics
+  {
+    noInterrupts();
+    stats = m_stats;
+    interrupts();
+
+    StatsTiming *timings[] = { &stats.refresh, &stats.analog, &stats.reset };
+
+    for (byte u = 0; u < sizeof(timings) / sizeof(timings[0]); u++)
+    {
+      StatsTiming &t = *timings[u];
+
+      if (t.count)
+      {
+        t.mean = t.total / t.count;
+      }
+      else
+      {
+        t.min = 0;
+      }
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Reset the statistics
+  //
+  // The longest gap is measured from the last refresh before this call.
+  void
+  ResetStats()
+  {
+    noInterrupts();
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stats.refresh.min = ~0UL;
+    m_stats.analog.min = ~0UL;
+    m_stats.reset.min = ~0UL;
+    interrupts();
+  }
+#endif
+
+protected:
+  //-------------------------------------------------------------------------
+  // External interrupt handler for analog measurements
+  static void
+  AnalogIsr();
 };
 
 
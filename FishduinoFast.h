@@ -0,0 +1,360 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  This module provides a variant of the Fishduino class of which the pin
+  numbers are fixed at compile time, by using template parameters.
+
+  On Arduinos that are based on the ATmega328P and its siblings (Uno, Nano,
+  Pro Mini etc.), the compiler can then figure out which port register and
+  bit are used for each pin, so that the shift functions can toggle the
+  CLOCK, DATA OUT and LOAD OUT lines with single SBI/CBI instructions. This
+  makes refreshing the interface(s) many times faster than going through
+  digitalWrite and digitalRead.
+
+  On other Arduinos, the class uses the digitalWriteFast and
+  digitalReadFast macros if they're defined (e.g. by including
+  digitalWriteFast.h before this file), and otherwise falls back to
+  digitalWrite and digitalRead, so it can be used anywhere, but then
+  there's no speed advantage.
+
+  If UseSPI is called and succeeds, the SPI hardware is used instead, the
+  same way as in the Fishduino class.
+
+  Example, for an interface that's connected to the default pins:
+
+    FishduinoFast<> ft;
+
+  Example, for an interface that's connected to other pins:
+
+    FishduinoFast<12, 2, 3, 4, 5, 6, 7> ft;
+
+  The order of the template parameters is the same as the order of the
+  parameters of the Fishduino constructor.
+
+  The fast shift function can also be used by other Fishduino objects,
+  such as FishduinoMgr, as long as they're connected to the same pins.
+  Then the update functions and the background refresh of the manager use
+  it too:
+
+    FishduinoMgr fishduino;             // Default pins 2-8
+
+    void setup()
+    {
+      FishduinoFast<>::Attach(fishduino);
+    }
+*/
+
+
+#ifndef _FISHDUINOFAST_H_
+#define _FISHDUINOFAST_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Fishduino.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Processors of which the pin-to-port mapping is known at compile time
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) \
+ || defined(__AVR_ATmega168P__) || defined(__AVR_ATmega168__) \
+ || defined(__AVR_ATmega88P__)  || defined(__AVR_ATmega88__)  \
+ || defined(__AVR_ATmega48P__)  || defined(__AVR_ATmega48__)
+#define FISHDUINOFAST_DIRECT
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// FAST PIN
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Compile-time pin
+//
+// On the ATmega328P, Arduino pins 0-7 are on port D, pins 8-13 are on port
+// B and pins 14-19 (A0-A5) are on port C. The register addresses below are
+// data memory addresses; the compiler turns accesses to them into SBI, CBI
+// and SBIS/SBIC instructions. Higher pin numbers don't exist on these
+// processors, so they're rejected at compile time.
+template <byte PIN>
+class FishduinoFastPin
+{
+#ifdef FISHDUINOFAST_DIRECT
+  static_assert(PIN < 20, "FishduinoFastPin only knows pins 0-19");
+
+protected:
+  enum
+  {
+    PortReg     = (PIN < 8) ? 0x2B : (PIN < 14) ? 0x25 : 0x28,  // PORTx
+    PinReg      = (PIN < 8) ? 0x29 : (PIN < 14) ? 0x23 : 0x26,  // PINx
+    Mask        = 1 << ((PIN < 8) ? PIN : (PIN < 14) ? PIN - 8 : PIN - 14),
+  };
+#endif
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the pin high or low
+  static void
+  Write(
+    bool value)                         // True=HIGH, false=LOW
+  {
+#if defined(FISHDUINOFAST_DIRECT)
+    if (value)
+    {
+      *(volatile uint8_t *)PortReg |= Mask;
+    }
+    else
+    {
+      *(volatile uint8_t *)PortReg &= ~Mask;
+    }
+#elif defined(digitalWriteFast)
+    digitalWriteFast(PIN, value ? HIGH : LOW);
+#else
+    digitalWrite(PIN, value ? HIGH : LOW);
+#endif
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Read the pin
+  static bool                           // Returns true=HIGH, false=LOW
+  Read()
+  {
+#if defined(FISHDUINOFAST_DIRECT)
+    return (*(volatile uint8_t *)PinReg & Mask) != 0;
+#elif defined(digitalReadFast)
+    return digitalReadFast(PIN) != LOW;
+#else
+    return digitalRead(PIN) != LOW;
+#endif
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// FAST FISHDUINO
+/////////////////////////////////////////////////////////////////////////////
+
+
+template <
+  byte PIN_DATACOUNTIN  = 2,
+  byte PIN_TRIGGERX     = 3,
+  byte PIN_TRIGGERY     = 4,
+  byte PIN_DATAOUT      = 5,
+  byte PIN_CLOCK        = 6,
+  byte PIN_LOADOUT      = 7,
+  byte PIN_LOADIN       = 8>
+class FishduinoFast : public Fishduino
+{
+protected:
+  typedef FishduinoFastPin<PIN_DATACOUNTIN> PinDataCountIn;
+  typedef FishduinoFastPin<PIN_DATAOUT>     PinDataOut;
+  typedef FishduinoFastPin<PIN_CLOCK>       PinClock;
+  typedef FishduinoFastPin<PIN_LOADOUT>     PinLoadOut;
+  typedef FishduinoFastPin<PIN_LOADIN>      PinLoadIn;
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  FishduinoFast(
+    byte num_interfaces = 1)
+  : Fishduino(
+    PIN_DATACOUNTIN,
+    PIN_TRIGGERX,
+    PIN_TRIGGERY,
+    PIN_DATAOUT,
+    PIN_CLOCK,
+    PIN_LOADOUT,
+    PIN_LOADIN,
+    num_interfaces)
+  {
+    Attach(*this);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Shift output bytes out and (optionally) input bytes in
+  //
+  // This does the same as Fishduino::ShiftBits (see there), with the pins
+  // of the template parameters.
+  static void
+  FastShift(
+    byte num,                           // Number of interfaces, at least 1
+    const byte *outvalues,              // num bytes (NULL=all off)
+    byte *invalues)                     // num bytes (NULL=don't read)
+  {
+    const byte *p = outvalues ? outvalues + num : NULL;
+    byte data = 0;
+
+    PinLoadOut::Write(LOW);
+
+    // The first rising edge of the clock loads the inputs
+    if (invalues)
+    {
+      PinLoadIn::Write(HIGH);
+    }
+
+    for (byte v = 0; v < num; v++)
+    {
+      byte b = outvalues ? *--p : 0;
+
+      for (byte u = 0; u < 8; u++, b <<= 1)
+      {
+        PinClock::Write(LOW);
+        PinDataOut::Write((b & 0x80) != 0);
+
+        if ((invalues) && (v | u))
+        {
+          data <<= 1;
+          data |= !PinDataCountIn::Read();
+
+          if (!u)
+          {
+            invalues[v - 1] = data;
+          }
+        }
+
+        PinClock::Write(HIGH);
+
+        if ((invalues) && !(v | u))
+        {
+          PinLoadIn::Write(LOW);
+        }
+      }
+    }
+
+    PinLoadOut::Write(HIGH);
+    PinLoadOut::Write(LOW);
+
+    if (invalues)
+    {
+      data <<= 1;
+      data |= !PinDataCountIn::Read();
+
+      invalues[num - 1] = data;
+
+      PinClock::Write(LOW);
+      PinClock::Write(HIGH);
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Let a Fishduino object (or a manager) use the compile-time pins
+  //
+  // After this, all functions of the object that shift data to and from
+  // the interface use the FastShift function above, see
+  // Fishduino::UseShiftFunc. The object must be connected to the pins of
+  // the template parameters; if it isn't, this returns false.
+  static bool                           // Returns True=fast pins in use
+  Attach(
+    Fishduino &fishduino)               // Object to speed up
+  {
+    return fishduino.UseShiftFunc(&FastShift,
+      PIN_DATACOUNTIN, PIN_DATAOUT, PIN_CLOCK, PIN_LOADOUT, PIN_LOADIN);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Read the digital inputs from the interfaces
+  //
+  // See Fishduino::GetInputs
+  void GetInputs(
+    byte *values)                       // One byte per interface
+  {
+    if (m_spi)
+    {
+      Fishduino::GetInputs(values);
+      return;
+    }
+
+#ifdef FISHDUINO_STATS
+    unsigned long start = micros();
+#endif
+
+    PinLoadIn::Write(HIGH);
+    PinClock::Write(LOW);
+    PinClock::Write(HIGH);
+    PinLoadIn::Write(LOW);
+
+    if (values)
+    {
+      for (unsigned v = 0; v < m_num_interfaces; v++)
+      {
+        byte data = 0;
+
+        for (unsigned u = 0; u < 8; u++)
+        {
+          data <<= 1;
+
+          data |= !PinDataCountIn::Read();
+
+          PinClock::Write(LOW);
+          PinClock::Write(HIGH);
+        }
+
+        values[v] = data;
+      }
+    }
+
+#ifdef FISHDUINO_STATS
+    StatsTime(m_stats.refresh, start);
+#endif
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set number of interfaces and then get digital inputs
+  void GetInputs(
+    byte num_interfaces,                // Number of interfaces
+    byte *values)                       // One byte per interface
+  {
+    SetNumInterfaces(num_interfaces);
+    GetInputs(values);
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
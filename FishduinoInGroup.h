@@ -0,0 +1,302 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  This module represents a group of input pins on up to four cascaded
+  FischerTechnik interfaces.
+
+  The group has a 32-bit mask in which each byte corresponds to one
+  interface (see FishduinoMgrN::NumWords), so the pins of a group can be
+  tested with one masked word operation, no matter how many interfaces
+  they're on. For example, for limit switches on I1 of interface 0 and I3
+  of interface 1:
+
+    FishduinoInGroup limits(fishduino,
+      FishduinoInGroup::Bit(0, FishduinoInGroup::I1) |
+      FishduinoInGroup::Bit(1, FishduinoInGroup::I3));
+
+    if (!limits.IsOff()) ...
+
+  All pins of a group must be on the same four interfaces: 0-3 (word 0),
+  4-7 (word 1) etc.
+
+  IMPORTANT: These store a reference to a Fishduino manager, but there is no
+  code to guard against orphaning this reference. Make sure you don't call
+  any of the member functions after the manager is destroyed!
+
+  NOTE: These only get the bits from an Fishduino manager, they don't update
+  the actual interface inputs; you have to call the appropriate function in
+  the manager to do that.
+*/
+
+
+#ifndef _FISHDUINOINGROUP_H_
+#define _FISHDUINOINGROUP_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INPUT GROUPS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Input Group
+//
+// An instance of this type can be used to get the value of input pins on
+// several interfaces.
+template <class MGR = FishduinoMgr>
+class FishduinoInGroupT
+{
+#ifndef NDEBUG
+public:
+#else
+protected:
+#endif
+  MGR            &m_mgr;                // Manager to work with
+  byte            m_wordindex;          // Word index, 0=interfaces 0-3
+  uint32_t        m_mask;               // Bits to check
+
+public:
+  //-------------------------------------------------------------------------
+  // Constants for better readability
+  //
+  // Use these as pin number to connect a device to the corresponding input
+  // pin.
+  enum {
+    I1 = 0,
+    I2,
+    I3,
+    I4,
+    I5,
+    I6,
+    I7,
+    I8
+  };
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the bit in a group mask for a pin
+  static uint32_t                       // Returns mask with one bit set
+  Bit(
+    byte intindex,                      // Interface index
+    byte pin)                           // Pin number (0..7)
+  {
+    return 1UL << (((intindex & 3) << 3) + pin);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor based on a mask
+  FishduinoInGroupT(
+    MGR &mgr,                           // Manager to work with
+    uint32_t mask,                      // Bits, see Bit
+    byte wordindex = 0)                 // Word index, 0=interfaces 0-3
+    : m_mgr(mgr)
+    , m_wordindex(wordindex)
+    , m_mask(mask)
+  {
+    // Nothing to do here
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a pin to the mask
+  void
+  AddPin(
+    byte intindex,                      // Interface index
+    byte pin)                           // Pin to add
+  {
+    m_mask |= Bit(intindex, pin);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Remove a pin from the mask
+  void
+  RemovePin(
+    byte intindex,                      // Interface index
+    byte pin)                           // Pin to remove
+  {
+    m_mask &= ~Bit(intindex, pin);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the debounce threshold of these bits
+  //
+  // See FishduinoMgr::SetInputDebounce. The thresholds are stored per
+  // interface, so this sets them one interface at a time.
+  void
+  SetDebounce(
+    byte threshold)                     // Number of refreshes, 1=off
+  {
+    for (byte u = 0; u < 4; u++)
+    {
+      byte mask = (byte)(m_mask >> (u << 3));
+
+      if (mask)
+      {
+        m_mgr.SetInputDebounce((m_wordindex << 2) + u, mask, threshold);
+      }
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the bits in the group
+  //
+  // If the bool parameter is false (default), the function returns true if
+  // ANY of the bits are high; if the parameter is true, it returns true only
+  // if ALL relevant bits are high.
+  //
+  // Note: this doesn't actually update the value from the inputs, you need
+  // to call the appropriate update function on the manager for that.
+  bool                                  // Returns true=pin is on
+  Get(
+    bool all = false)                   // True=AND pins, false=OR pins
+  {
+    uint32_t b = m_mgr.GetInputWord(m_wordindex) & m_mask;
+
+    return all ? (b == m_mask) : (b != 0);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if pins in our mask have the given state
+  //
+  // If both parameters are true, the function returns true if the pins in
+  // the mask are either all on or all off, false if some pins are on and
+  // some are off.
+  //
+  // If both parameters are false, the function returns true if and only if
+  // some pins are on but not none and not all.
+  bool
+  Is(
+    bool off,                           // True=return true if all pins off
+    bool on)                            // True=return true if all pins on
+  {
+    return Check(m_mgr.GetInputWord(m_wordindex) & m_mask, off, on);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if pins in our mask are all off
+  bool IsOff()
+  {
+    return Is(true, false);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if pins in our mask are all on
+  bool IsOn()
+  {
+    return Is(false, true);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if pins in our mask had the given state before the last update
+  //
+  // See Is.
+  bool
+  Was(
+    bool off,                           // True=return true if all pins off
+    bool on)                            // True=return true if all pins on
+  {
+    return Check(m_mgr.GetPrevInputWord(m_wordindex) & m_mask, off, on);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if pins in our mask were all off before the last update
+  bool WasOff()
+  {
+    return Was(true, false);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if pins in our mask were all on before the last update
+  bool WasOn()
+  {
+    return Was(false, true);
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Check the masked bits for Is and Was
+  bool
+  Check(
+    uint32_t b,                         // Masked bits
+    bool off,                           // True=return true if all pins off
+    bool on)                            // True=return true if all pins on
+  {
+    bool result;
+
+    if (b == 0)
+    {
+      result = off;
+    }
+    else if (b == m_mask)
+    {
+      result = on;
+    }
+    else
+    {
+      result = ((!on) && (!off));
+    }
+
+    return result;
+  }
+};
+
+
+// Input group on the interfaces of the compatible manager. For other
+// managers, use FishduinoInGroupT<> with the type of the manager, see
+// FishduinoMgr.h.
+typedef FishduinoInGroupT<> FishduinoInGroup;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
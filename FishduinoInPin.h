@@ -64,7 +64,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 // An instance of this type can be used to get the value of one or more
 // digital input pins.
-class FishduinoInPin
+template <class MGR = FishduinoMgr>
+class FishduinoInPinT
 {
 #ifndef NDEBUG
 public:
@@ -72,7 +73,7 @@ public:
 protected:
 #endif
 protected:
-  FishduinoMgr   &m_mgr;                // Manager to work with
+  MGR            &m_mgr;                // Manager to work with
   byte            m_intindex;           // Interface index
   byte            m_mask;               // Bits to set/reset
 
@@ -96,8 +97,8 @@ public:
 public:
   //-------------------------------------------------------------------------
   // Constructor based on single bit
-  FishduinoInPin(
-    FishduinoMgr &mgr,                  // Manager to work with
+  FishduinoInPinT(
+    MGR &mgr,                           // Manager to work with
     byte intindex,                      // Interface index
     byte pin)                           // Pin number (0..7)
     : m_mgr(mgr)
@@ -127,6 +128,18 @@ public:
     m_mask &= ~(1 << pin);
   }
 
+public:
+  //-------------------------------------------------------------------------
+  // Set the debounce threshold of these bits
+  //
+  // See FishduinoMgr::SetInputDebounce.
+  void
+  SetDebounce(
+    byte threshold)                     // Number of refreshes, 1=off
+  {
+    m_mgr.SetInputDebounce(m_intindex, m_mask, threshold);
+  }
+
 public:
   //-------------------------------------------------------------------------
   // Get these bits on the interface
@@ -249,6 +262,11 @@ public:
 };
 
 
+// Input pin(s) on an interface of the compatible manager. For other managers,
+// use FishduinoInPinT<> with the type of the manager, see FishduinoMgr.h.
+typedef FishduinoInPinT<> FishduinoInPin;
+
+
 /////////////////////////////////////////////////////////////////////////////
 // END
 /////////////////////////////////////////////////////////////////////////////
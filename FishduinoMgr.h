@@ -43,183 +43,1909 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   function often enough, e.g. from your loop() function or even from a timer
   interrupt. When using a timer interrupt, it should be possible to update
   the interface so fast that PWM by bit-banging can be implemented.
+
+  To let a timer interrupt refresh the interface in the background, include
+  FishduinoTimer.h and call FishduinoTimer::Begin. See that file for more
+  information.
+
+  The manager is a template, FishduinoMgrN<N>, where N is the number of
+  interfaces in the chain. The buffers are sized for exactly N interfaces,
+  and the shift loops have a fixed length, so the compiler can unroll
+  them. N can be more than Fishduino::MaxInterfaces, for long chains.
+  FishduinoMgr is the original manager: it has room for MaxInterfaces
+  interfaces, and the number of interfaces that's actually used is set at
+  run time, like in the Fishduino base class. For example:
+
+    FishduinoMgrN<1> fishduino;         // One interface on pins 2-8
+    FishduinoMgrN<6> bigrig(2);         // Six cascaded interfaces
+    FishduinoMgr compatible(2, 2);      // Two interfaces, set at run time
+
+  The pin and motor classes work with FishduinoMgr; for other managers,
+  use the templates on which they are based, e.g.
+  FishduinoOutPinT<FishduinoMgrN<6> >.
 */
 
 
-#ifndef _FISHDUINOMGR_H_
-#define _FISHDUINOMGR_H_
+#ifndef _FISHDUINOMGR_H_
+#define _FISHDUINOMGR_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Fishduino.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Number of entries in the input event queue; must be a power of 2.
+// Define this before including this file to change it.
+#ifndef FISHDUINO_EVENT_QUEUE_SIZE
+#define FISHDUINO_EVENT_QUEUE_SIZE 16
+#endif
+
+// Compiler barrier: keeps the compiler from moving memory accesses across
+// it. The event queue uses this so that the events themselves don't have to
+// be volatile.
+#define FISHDUINO_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+
+/////////////////////////////////////////////////////////////////////////////
+// FISHDUINO MANAGER
+/////////////////////////////////////////////////////////////////////////////
+
+
+template <byte N, bool FIXED = true>
+class FishduinoMgrN : public Fishduino
+{
+public:
+  // Chain length
+  //
+  // If FIXED is true, the manager always refreshes N interfaces. Otherwise
+  // N is the maximum, and the number of interfaces is set at run time with
+  // the constructor or with SetNumInterfaces.
+  enum
+  {
+    NumInterfaces = N,                  // Number of interfaces (maximum)
+    AllInterfaces = 0xFF,               // Interface index for all interfaces
+  };
+
+  // Wide words
+  //
+  // The inputs and outputs are also available as 32-bit words of four
+  // interfaces each: word 0 has interface 0 in bits 0-7, interface 1 in
+  // bits 8-15 etc., word 1 starts with interface 4. That way, a group of
+  // pins on several interfaces can be tested or changed with one masked
+  // word operation; see GetInputWord and SetOutputWord. The buffers are
+  // padded to a multiple of four interfaces, and the words overlap the
+  // bytes, which only works on little-endian processors (such as the AVR
+  // and ARM processors of the Arduino boards).
+  enum
+  {
+    NumWords = (N + 3) / 4,             // Number of 32-bit words
+  };
+
+  // Software PWM
+  //
+  // Outputs can be switched on and off by the refresh function to control
+  // the brightness of lamps and the speed of motors. Each tick advances
+  // a counter; an output that has a duty level of n is on during n out of
+  // PwmLevels ticks. So at 1000 ticks per second, the PWM frequency
+  // is 1000/PwmLevels Hz.
+  enum
+  {
+    PwmBits = 4,                        // Bits of PWM resolution
+    PwmLevels = 1 << PwmBits,           // Number of PWM steps
+  };
+
+  // Input debouncing
+  //
+  // Each input has a counter that goes up at each refresh where the input
+  // differs from its debounced state, and down (to 0) at each refresh where
+  // it's the same. When the counter reaches the threshold of the input, the
+  // debounced state changes. The threshold is 1 by default, which means no
+  // debouncing. See SetInputDebounce.
+  enum
+  {
+    DebounceBits = 3,                   // Bits per debounce counter
+    MaxDebounce = (1 << DebounceBits) - 1, // Maximum threshold
+  };
+
+  // Output refresh scheduling
+  //
+  // The interface turns its outputs off if they aren't refreshed for about
+  // half a second. UpdateOutputs only shifts the outputs out if they
+  // changed, or if the last refresh was more than the keep-alive interval
+  // ago (see SetKeepAlive).
+  enum
+  {
+    WatchdogTimeout = 500,              // Output timeout of interface (ms)
+    DefaultKeepAlive = 400,             // Default keep-alive interval (ms)
+  };
+
+  // Ticks
+  //
+  // Objects that control outputs by themselves (such as stepper motors)
+  // can have a function called at every tick, see AddTickHandler. The
+  // tick also advances the output sequences and the software PWM. If the
+  // interface is refreshed by a timer, every refresh is a tick; otherwise
+  // the update functions make ticks at the tick rate, see SetTickRate.
+  enum
+  {
+    MaxTickHandlers = 4,                // Maximum number of tick handlers
+    DefaultTickRate = 1000,             // Default ticks per second
+  };
+
+  // Function that's called at every tick, see AddTickHandler
+  typedef void (*TickHandler)(void *context);
+
+  // Interlocks
+  //
+  // Rules that switch outputs off (or on) when inputs are in a given
+  // state, checked at every refresh. See AddInterlock.
+  enum
+  {
+    MaxInterlocks = 8,                  // Maximum number of interlock rules
+  };
+
+  // Output refresh statistics, see GetOutputStats
+  struct OutputStats
+  {
+    unsigned long   changes;            // Refreshes because outputs changed
+    unsigned long   keepalives;         // Refreshes to keep outputs alive
+    unsigned long   skipped;            // Refreshes skipped, no change
+    long            worstmargin;        // Least time left before timeout (ms)
+  };
+
+  // Input event
+  //
+  // Every time the inputs are refreshed, the manager compares them to the
+  // previous inputs, and stores an event for each input that changed.
+  // See GetEvent.
+  struct InputEvent
+  {
+    unsigned long   time;               // micros() at the refresh
+    byte            intindex;           // Interface index, 0=first
+    byte            pin;                // Input pin, 0=first(!)
+    bool            on;                 // True=went on, false=went off
+  };
+
+  // Step of an output sequence
+  //
+  // A sequence is an array of steps in flash memory (PROGMEM), ended by a
+  // step with a duration of 0. Each step sets the outputs that are
+  // controlled by the sequence (see SetSequenceMask) for the given number
+  // of ticks. See PlaySequence. Example:
+  //
+  //   const FishduinoMgr::Step chaser[] PROGMEM =
+  //   {
+  //     { { 0x01 }, 100 },
+  //     { { 0x04 }, 100 },
+  //     { { 0x10 }, 100 },
+  //     { { 0x40 }, 100 },
+  //     { { 0 }, 0 }
+  //   };
+  struct Step
+  {
+    byte            outputs[N];         // Output bytes, 1 per interface
+    uint16_t        ticks;              // Duration in ticks, 0=end
+  };
+
+  // Interlock rule, see AddInterlock
+  struct Interlock
+  {
+    byte            inindex;            // Interface index of the inputs
+    byte            inmask;             // Inputs to check
+    byte            invalue;            // Input state that triggers the rule
+    byte            outindex;           // Interface index of the outputs
+    byte            andmask;            // Outputs to keep, others off
+    byte            ormask;             // Outputs to switch on
+  };
+
+#ifndef NDEBUG
+public:
+#else
+protected:
+#endif
+  // Output state
+  //
+  // Software PWM: the duty levels are stored as bit planes: bit n of
+  // pwmplane[k][i] is bit k of the duty level of output n on interface i.
+  // That way, the refresh function can compare the levels of all 8 outputs
+  // of an interface with the PWM counter in a few byte operations.
+  //
+  // Outputs of which the bit is set in pwmmask are switched on only while
+  // the counter is below their duty level; the corresponding bit in
+  // outputs is still set, so the output reads as on.
+  struct OutputBank
+  {
+    union
+    {
+      byte          outputs[NumWords * 4]; // Digital outputs
+      uint32_t      outwords[NumWords]; // Same as words
+    };
+    union
+    {
+      byte          pwmmask[NumWords * 4]; // Outputs that use PWM
+      uint32_t      pwmwords[NumWords]; // Same as words
+    };
+    byte            pwmplane[PwmBits][N]; // Duty bit planes
+  };
+
+  // There are two copies of the output state. The refresh function only
+  // reads the live bank; the application changes the bank that m_bank
+  // points to. Normally that's the live bank, but between BeginUpdate and
+  // Commit it's the other bank, and Commit makes it the live bank with
+  // a single byte write.
+  volatile OutputBank m_banks[2];               // Output state
+  volatile OutputBank *m_bank;                  // Bank to change
+  volatile byte     m_live;                     // Bank to refresh from
+  byte              m_batch;                    // BeginUpdate nesting level
+  byte              m_pwmcounter;               // PWM counter
+
+  union
+  {
+    volatile byte   m_inputs[NumWords * 4];     // Digital inputs
+    volatile uint32_t m_inwords[NumWords];      // Same as words
+  };
+  union
+  {
+    byte            m_previnputs[NumWords * 4]; // Input cache
+    uint32_t        m_previnwords[NumWords];    // Same as words
+  };
+
+  // Background refresh
+  //
+  // When the interface is refreshed by an interrupt handler (see Tick),
+  // the interrupt handler stores the inputs in a separate buffer. The
+  // update functions copy them to the input buffers above, so the main
+  // program sees the inputs change only when it calls an update function,
+  // the same way as when it refreshes the interface by itself.
+  //
+  // The interrupt handler increments m_inputseq before and after it
+  // changes m_isrinputs, so the main program can read them without
+  // disabling interrupts: if the sequence number is odd or changed during
+  // the read, it reads them again. See Snapshot.
+  volatile byte     m_isrinputs[N];             // Inputs read by Tick
+  volatile byte     m_inputseq;                 // Sequence number of inputs
+  volatile bool     m_background;               // True=Tick refreshes
+  volatile bool     m_analogbusy;               // True=analog in progress
+
+  // Output refresh scheduling
+  byte              m_sentoutputs[N];           // Outputs last sent
+  unsigned long     m_lastsent;                 // millis() of last refresh
+  unsigned          m_keepalive;                // Keep-alive interval (ms)
+  OutputStats       m_outputstats;              // Statistics
+
+  // Ticks of the update functions, see SetTickRate
+  unsigned long     m_tickinterval;             // Time between ticks (us)
+  unsigned long     m_lasttick;                 // micros() of last tick
+
+  // Input debouncing
+  //
+  // The counters and thresholds are stored as bit planes, the same way as
+  // the PWM duty levels: bit n of m_debcount[k][i] is bit k of the counter
+  // of input n on interface i. That way, the counters of all 8 inputs of an
+  // interface are updated in a few byte operations ("vertical counters").
+  byte              m_debcount[DebounceBits][N]; // Counters
+  byte              m_debthreshold[DebounceBits][N]; // Thresholds
+  unsigned          m_compatdebounce;           // Count of UpdateInputs, 0=none
+
+  // Input event queue
+  //
+  // The refresh function (which may run in an interrupt handler) is the
+  // only one that writes events and advances the head; the application is
+  // the only one that reads events and advances the tail. Both indexes are
+  // single bytes, so no locking is needed.
+  InputEvent        m_events[FISHDUINO_EVENT_QUEUE_SIZE];
+  volatile byte     m_eventhead;                // Next event to write
+  volatile byte     m_eventtail;                // Next event to read
+  volatile unsigned m_eventslost;               // Events lost, queue full
+
+  // Output sequence
+  //
+  // The steps are read from flash at every refresh, so a sequence doesn't
+  // use any RAM. The tick (which may run in an interrupt handler) advances
+  // the sequence; the application only changes these with interrupts
+  // disabled.
+  const Step *volatile m_seq;                   // Sequence playing, or NULL
+  const Step *volatile m_seqstep;               // Current step
+  uint16_t          m_seqticks;                 // Ticks left in step
+  byte              m_seqrepeat;                // Times left, 0=forever
+  const Step       *m_seqnext;                  // Chained sequence or NULL
+  byte              m_seqnextrepeat;            // Times to play chained seq
+  volatile byte     m_seqmask[N];               // Outputs of the sequence
+
+  // Tick handlers
+  //
+  // The outputs that are controlled by tick handlers are stored separately
+  // from the other outputs, so the application and the handlers (which may
+  // run in an interrupt handler) never change the same byte.
+  TickHandler       m_tickfunc[MaxTickHandlers]; // Handler functions
+  void             *m_tickcontext[MaxTickHandlers]; // Handler contexts
+  volatile byte     m_numtickhandlers;          // Number of tick handlers
+  volatile byte     m_tickmask[N];              // Outputs of tick handlers
+  volatile byte     m_tickoutputs[N];           // Output values of handlers
+
+  // Interlocks
+  //
+  // Bit n of each mask corresponds to rule n.
+  Interlock         m_interlocks[MaxInterlocks]; // Rules
+  volatile byte     m_numinterlocks;            // Number of rules
+  volatile byte     m_interlocklatch;           // Rules that latch
+  volatile byte     m_interlocklatched;         // Latched rules
+  volatile byte     m_interlockactive;          // Rules active last refresh
+
+private:
+  //-------------------------------------------------------------------------
+  // Private function called during construction
+  void Init()
+  {
+    m_live = 0;
+    m_bank = &m_banks[0];
+    m_batch = 0;
+
+    m_inputseq = 0;
+
+    m_background = false;
+    m_analogbusy = false;
+
+    memset((void *)m_inputs, 0, sizeof(m_inputs));
+
+    m_eventhead = 0;
+    m_eventtail = 0;
+
+    m_seq = NULL;
+    m_seqnext = NULL;
+    memset((void *)m_seqmask, 0xFF, sizeof(m_seqmask));
+
+    m_numtickhandlers = 0;
+    memset((void *)m_tickoutputs, 0, sizeof(m_tickoutputs));
+
+    m_numinterlocks = 0;
+    m_interlocklatch = 0;
+    m_interlocklatched = 0;
+    m_interlockactive = 0;
+
+    memset(m_debcount, 0, sizeof(m_debcount));
+    SetInputDebounce(AllInterfaces, 0xFF, 1);
+    m_compatdebounce = 0;
+
+    m_keepalive = DefaultKeepAlive;
+    m_lastsent = millis();
+    ResetOutputStats();
+
+    SetTickRate(DefaultTickRate);
+
+    Reset();
+    Update();
+
+    // The initial state of the inputs doesn't count as a change
+    FlushEvents();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  FishduinoMgrN(
+    byte pin_datacountin,
+    byte pin_triggerx,
+    byte pin_triggery,
+    byte pin_dataout,
+    byte pin_clock,
+    byte pin_loadout,
+    byte pin_loadin,
+    byte num_interfaces = 1)            // Ignored if FIXED
+  : Fishduino(
+    pin_datacountin,
+    pin_triggerx,
+    pin_triggery,
+    pin_dataout,
+    pin_clock,
+    pin_loadout,
+    pin_loadin,
+    FIXED ? N : num_interfaces)
+  {
+    Init();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Simpler constructor for when connected to consecutive Arduino pins
+  FishduinoMgrN(
+    byte startpin = 2,
+    byte num_interfaces = 1)            // Ignored if FIXED
+  : Fishduino(
+    startpin,
+    FIXED ? N : num_interfaces)
+  {
+    Init();
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Get the number of interfaces to refresh
+  //
+  // If FIXED is true, this is a constant, so the loops that use it have a
+  // fixed number of iterations. The count of the base class may be lower,
+  // because it can't be more than MaxInterfaces; the manager doesn't use
+  // the base class functions that depend on it.
+  //
+  // If FIXED is false, the count of the base class may also be higher than
+  // N (SetNumInterfaces and Probe only limit it to MaxInterfaces), so it's
+  // limited to N here, to stay inside the buffers.
+  byte                                  // Returns number of interfaces
+  Count()
+  {
+    return FIXED ? N : min(m_num_interfaces, (byte)N);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Reset the outputs
+  void
+  Reset()
+  {
+    StopSequence();
+    ReleaseTickOutputs(AllInterfaces, 0xFF);
+    memset((void *)m_bank, 0, sizeof(OutputBank));
+    m_pwmcounter = 0;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Go to the next step of the output sequence
+  //
+  // At the end of the sequence, it's repeated, or the chained sequence is
+  // started, or the sequence stops.
+  void
+  NextStep()
+  {
+    const Step *step = m_seqstep + 1;
+    uint16_t ticks = pgm_read_word(&step->ticks);
+
+    if (!ticks)
+    {
+      if (m_seqrepeat != 1)
+      {
+        if (m_seqrepeat)
+        {
+          m_seqrepeat--;
+        }
+      }
+      else if (m_seqnext)
+      {
+        m_seq = m_seqnext;
+        m_seqrepeat = m_seqnextrepeat;
+        m_seqnext = NULL;
+      }
+      else
+      {
+        m_seq = NULL;
+        return;
+      }
+
+      step = m_seq;
+      ticks = pgm_read_word(&step->ticks);
+
+      if (!ticks)
+      {
+        // Empty sequence
+        m_seq = NULL;
+        return;
+      }
+    }
+
+    m_seqstep = step;
+    m_seqticks = ticks;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Advance the outputs by one tick
+  //
+  // This calls the tick handlers, goes to the next step of the output
+  // sequence if the current one is done, and advances the PWM counter.
+  // It's called before the outputs of a tick are composed, so that the
+  // outputs that the tick handlers change are sent in the same refresh.
+  void
+  AdvanceTick()
+  {
+    m_pwmcounter = (m_pwmcounter + 1) & (PwmLevels - 1);
+
+    for (byte h = 0; h < m_numtickhandlers; h++)
+    {
+      m_tickfunc[h](m_tickcontext[h]);
+    }
+
+    if (m_seq)
+    {
+      if (!m_seqticks)
+      {
+        NextStep();
+      }
+
+      if (m_seq)
+      {
+        m_seqticks--;
+      }
+    }
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Check if it's time for a tick of the update functions
+  //
+  // See SetTickRate. If the update functions are called less often than
+  // the tick rate, every call is a tick; missed ticks aren't made up,
+  // because the outputs of the ticks in between would never be sent.
+  bool                                  // Returns true=advance one tick
+  IsTickDue()
+  {
+    if (!m_tickinterval)
+    {
+      return true;
+    }
+
+    unsigned long now = micros();
+
+    if (now - m_lasttick < m_tickinterval)
+    {
+      return false;
+    }
+
+    m_lasttick += m_tickinterval;
+
+    if (now - m_lasttick >= m_tickinterval)
+    {
+      m_lasttick = now;
+    }
+
+    return true;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Generate the output bytes for a refresh
+  //
+  // This doesn't change the state of the outputs (see AdvanceTick), so it
+  // can also be used to find out if the outputs changed since the last
+  // refresh. The output sources are combined in order of priority, from
+  // low to high:
+  //
+  // - The outputs set by the application (with PWM).
+  // - The current step of the output sequence, if one is playing, for the
+  //   outputs that it controls.
+  // - The outputs taken over by tick handlers (without PWM).
+  // - The interlocks, which override everything else.
+  //
+  // This applies the software PWM to the outputs. The duty levels are
+  // compared with the counter one bit plane at a time, from the most
+  // significant bit down, for all outputs of an interface at once:
+  // "greater" collects the outputs of which the level is known to be above
+  // the counter, "equal" keeps the outputs of which the bits were the same
+  // as the counter so far.
+  void
+  ComposeOutputs(
+    byte *outputs)                      // Output bytes, 1 per interface
+  {
+    byte counter = m_pwmcounter;
+    const Step *step = m_seq ? m_seqstep : NULL;
+    volatile OutputBank &bank = m_banks[m_live];
+
+    for (byte u = 0; u < Count(); u++)
+    {
+      byte value = bank.outputs[u];
+
+      if (step)
+      {
+        byte mask = m_seqmask[u];
+
+        value = (value & ~mask) | (pgm_read_byte(&step->outputs[u]) & mask);
+      }
+
+      byte greater = 0;
+      byte equal = 0xFF;
+
+      for (byte k = PwmBits; k-- > 0; )
+      {
+        byte plane = bank.pwmplane[k][u];
+
+        if (counter & (1 << k))
+        {
+          equal &= plane;
+        }
+        else
+        {
+          greater |= equal & plane;
+          equal &= ~plane;
+        }
+      }
+
+      value &= greater | ~bank.pwmmask[u];
+
+      byte tickmask = m_tickmask[u];
+
+      outputs[u] = (value & ~tickmask) | (m_tickoutputs[u] & tickmask);
+    }
+
+    if (m_numinterlocks)
+    {
+      ApplyInterlocks(outputs);
+    }
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Apply the interlock rules to the outputs of a refresh
+  //
+  // The rules are checked against the inputs of the most recent refresh,
+  // which is the current one in the case of Tick and Update.
+  // The masks of all active rules are combined first, so if one rule
+  // switches an output on and another one switches it off, it's off.
+  void
+  ApplyInterlocks(
+    byte *outputs)                      // Output bytes, 1 per interface
+  {
+    byte active = m_interlocklatched;
+
+    for (byte r = 0; r < m_numinterlocks; r++)
+    {
+      const Interlock &rule = m_interlocks[r];
+
+      if ((GetTickInputs(rule.inindex) & rule.inmask) == rule.invalue)
+      {
+        active |= 1 << r;
+      }
+    }
+
+    m_interlocklatched = active & m_interlocklatch;
+    m_interlockactive = active;
+
+    if (!active)
+    {
+      return;
+    }
+
+    byte andmask[N];
+    byte ormask[N];
+
+    memset(andmask, 0xFF, sizeof(andmask));
+    memset(ormask, 0, sizeof(ormask));
+
+    for (byte r = 0; r < m_numinterlocks; r++)
+    {
+      if (active & (1 << r))
+      {
+        const Interlock &rule = m_interlocks[r];
+
+        andmask[rule.outindex] &= rule.andmask;
+        ormask[rule.outindex] |= rule.ormask;
+      }
+    }
+
+    for (byte u = 0; u < Count(); u++)
+    {
+      outputs[u] = (outputs[u] | ormask[u]) & andmask[u];
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Update the outputs from the internal data
+  //
+  // The outputs are only shifted out if they changed since the last
+  // refresh, or if the last refresh is so long ago that the interface is
+  // about to turn the outputs off (see SetKeepAlive). So it's cheap to call
+  // this often, e.g. on every pass through loop(), and you should do that
+  // to make sure the outputs don't time out.
+  //
+  // The tick handlers, output sequences and software PWM advance at the
+  // tick rate (see SetTickRate), not at every call, so they run at the
+  // same speed no matter how often this is called. The outputs are
+  // composed at every call, so changes made by the application (and
+  // interlocks that became active) are sent right away.
+  //
+  // If the interface is refreshed in the background, this does nothing:
+  // the outputs are sent to the interface at the next Tick.
+  void
+  UpdateOutputs(
+    bool force = false)                 // True=refresh even if unchanged
+  {
+    if (!m_background)
+    {
+      byte outputs[N];
+
+      if (IsTickDue())
+      {
+        AdvanceTick();
+      }
+
+      ComposeOutputs(outputs);
+
+      if ((force) || (memcmp(outputs, m_sentoutputs, Count())))
+      {
+        m_outputstats.changes++;
+      }
+      else if (millis() - m_lastsent >= m_keepalive)
+      {
+        m_outputstats.keepalives++;
+      }
+      else
+      {
+        m_outputstats.skipped++;
+        return;
+      }
+
+      Shift(Count(), outputs, NULL);
+      OutputsSent(outputs);
+    }
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Keep track of the outputs that were sent to the interface
+  void
+  OutputsSent(
+    const byte *outputs)                // Outputs that were sent
+  {
+    unsigned long now = millis();
+    long margin = (long)WatchdogTimeout - (long)(now - m_lastsent);
+
+    if (margin < m_outputstats.worstmargin)
+    {
+      m_outputstats.worstmargin = margin;
+    }
+
+    if (outputs != m_sentoutputs)
+    {
+      memcpy(m_sentoutputs, outputs, Count());
+    }
+
+    m_lastsent = now;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the keep-alive interval
+  //
+  // If the outputs didn't change, UpdateOutputs refreshes them anyway when
+  // this many milliseconds have passed since the last refresh. This should
+  // be less than the timeout of the interface (WatchdogTimeout), with some
+  // room for the time that your loop() function needs for one pass.
+  void
+  SetKeepAlive(
+    unsigned ms)                        // Keep-alive interval (ms)
+  {
+    m_keepalive = ms;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the tick rate of the update functions
+  //
+  // When the interface is refreshed by a timer (see FishduinoTimer.h),
+  // every refresh is a tick. When the application calls Update and
+  // UpdateOutputs itself, a call is only a tick if 1/hz seconds have
+  // passed since the previous tick; the calls in between only send output
+  // changes (and read the inputs, in the case of Update). If the calls
+  // are further apart, the ticks are slower. So the tick handlers, output
+  // sequences and software PWM are timed the same way as with a timer of
+  // the given rate, as long as the main program keeps up with it.
+  //
+  // 0 makes every call a tick, like in older versions of the library.
+  void
+  SetTickRate(
+    unsigned long hz)                   // Ticks per second, 0=every call
+  {
+    m_tickinterval = hz ? 1000000UL / hz : 0;
+    m_lasttick = micros();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the output refresh statistics
+  //
+  // The worst margin is the smallest amount of time that was left before
+  // the interface would have timed out, at the time of a refresh. If it's
+  // negative, the outputs were off for a while.
+  void
+  GetOutputStats(
+    OutputStats &stats)                 // Receives statistics
+  {
+    noInterrupts();
+    stats = m_outputstats;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Reset the output refresh statistics
+  void
+  ResetOutputStats()
+  {
+    noInterrupts();
+    memset(&m_outputstats, 0, sizeof(m_outputstats));
+    m_outputstats.worstmargin = WatchdogTimeout;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Update the internal data from the inputs
+  //
+  // The inputs are read once, and passed through the debouncer (see
+  // SetInputDebounce), so this never takes longer than one refresh.
+  //
+  // For compatibility with older versions of the library, a debounce count
+  // can be passed. If it's nonzero, it sets the debounce threshold of all
+  // inputs to that number plus one, i.e. the inputs have to read the same
+  // for that many more refreshes before the change is seen. The threshold
+  // can't be more than MaxDebounce, so counts above MaxDebounce - 1 work
+  // the same as MaxDebounce - 1. If the count is 0 after a call with a
+  // nonzero count, debouncing is switched off again. The delay parameter
+  // is ignored.
+  //
+  // If the interface is refreshed in the background, the inputs from the
+  // most recent Tick are used.
+  void
+  UpdateInputs(
+    unsigned debouncecount = 0,         // Extra readings, below MaxDebounce
+    unsigned delayus = 0)               // Ignored
+  {
+    (void)delayus;
+
+    // Only change the thresholds if the count changed, because that
+    // restarts the counters. A count of 0 only switches debouncing off if
+    // an earlier call switched it on, so it doesn't undo SetInputDebounce.
+    if (debouncecount != m_compatdebounce)
+    {
+      if (debouncecount)
+      {
+        SetInputDebounce(AllInterfaces, 0xFF,
+          (debouncecount < MaxDebounce) ? debouncecount + 1 : MaxDebounce);
+        m_compatdebounce = debouncecount;
+      }
+      else
+      {
+        // This also sets m_compatdebounce to 0
+        SetInputDebounce(AllInterfaces, 0xFF, 1);
+      }
+    }
+
+    memcpy(m_previnputs, (const void *)m_inputs, sizeof(m_previnputs));
+
+    if (m_background)
+    {
+      FetchInputs();
+      return;
+    }
+
+    if (m_analogbusy)
+    {
+      return;
+    }
+
+    // The outputs that were sent last are sent again, so reading the inputs
+    // takes as many clock pulses as with GetInputs, and keeps the outputs
+    // alive too.
+    byte inputs[N];
+
+    Shift(Count(), m_sentoutputs, inputs);
+    StoreInputs(inputs);
+    OutputsSent(m_sentoutputs);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Update the outputs and inputs
+  //
+  // This shifts the outputs out and the inputs in during the same clock
+  // pulses, so it's about twice as fast as calling UpdateOutputs and
+  // UpdateInputs separately. If there are interlocks or tick handlers, the
+  // inputs are read in a separate pass before the outputs are composed, so
+  // that they can react in the same call; see Refresh.
+  void
+  Update()
+  {
+    memcpy(m_previnputs, (const void *)m_inputs, sizeof(m_previnputs));
+
+    if (m_background)
+    {
+      FetchInputs();
+    }
+    else
+    {
+      Refresh(IsTickDue(), false);
+    }
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Refresh the outputs and inputs for Update or Tick
+  //
+  // Interlocks and tick handlers react to the inputs, so if there are any,
+  // the inputs are read first (sending the previous outputs again, like
+  // UpdateInputs does), and then the outputs are composed and sent. That
+  // takes twice as many clock pulses, but the outputs react to the inputs
+  // in the same refresh, instead of one refresh later. Otherwise, the
+  // outputs and inputs are shifted during the same clock pulses.
+  //
+  // While an analog input is being read, only the outputs are refreshed,
+  // because the input shift registers and the analog timers share the
+  // DATA/COUNT IN line.
+  void
+  Refresh(
+    bool tick,                          // True=advance by one tick
+    bool isr)                           // True=store inputs for Tick
+  {
+    byte outputs[N];
+    byte inputs[N];
+
+    bool readfirst = (!m_analogbusy) &&
+      ((m_numinterlocks) || (m_numtickhandlers));
+
+    if (readfirst)
+    {
+      Shift(Count(), m_sentoutputs, inputs);
+      StoreRefreshInputs(inputs, isr);
+    }
+
+    if (tick)
+    {
+      AdvanceTick();
+    }
+
+    ComposeOutputs(outputs);
+
+    if ((readfirst) || (m_analogbusy))
+    {
+      Shift(Count(), outputs, NULL);
+    }
+    else
+    {
+      Shift(Count(), outputs, inputs);
+      StoreRefreshInputs(inputs, isr);
+    }
+
+    OutputsSent(outputs);
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Store the inputs of a refresh by Update or Tick
+  void
+  StoreRefreshInputs(
+    byte *inputs,                       // Inputs as read from interface
+    bool isr)                           // True=store inputs for Tick
+  {
+    if (!isr)
+    {
+      StoreInputs(inputs);
+      return;
+    }
+
+    Debounce(inputs, (const byte *)m_isrinputs);
+    DetectEdges(inputs, (const byte *)m_isrinputs);
+
+    // Let the main program know that the inputs are changing
+    m_inputseq++;
+
+    for (byte u = 0; u < Count(); u++)
+    {
+      m_isrinputs[u] = inputs[u];
+    }
+
+    m_inputseq++;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Debounce new inputs and store them
+  //
+  // This is used by the update functions; m_previnputs must contain the
+  // inputs from before the update.
+  void
+  StoreInputs(
+    byte *inputs)                       // Inputs as read from interface
+  {
+    Debounce(inputs, m_previnputs);
+    DetectEdges(inputs, m_previnputs);
+
+    memcpy((void *)m_inputs, inputs, Count());
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Run the debounce counters for a new sample of the inputs
+  //
+  // The samples are replaced by the debounced inputs. For each interface,
+  // the counters of the inputs that differ from the debounced state are
+  // incremented and the others are decremented (unless they're 0), using
+  // ripple-carry over the bit planes. The inputs of which the counter
+  // reaches the threshold change state and their counter is cleared.
+  void
+  Debounce(
+    byte *inputs,                       // Samples in, debounced out
+    const byte *state)                  // Previous debounced state
+  {
+    for (byte u = 0; u < Count(); u++)
+    {
+      byte c0 = m_debcount[0][u];
+      byte c1 = m_debcount[1][u];
+      byte c2 = m_debcount[2][u];
+
+      byte differ = inputs[u] ^ state[u];
+      byte down = ~differ & (c0 | c1 | c2);
+      byte carry;
+
+      // Increment the counters of the inputs that differ
+      carry = differ & c0;
+      c0 ^= differ;
+      c2 ^= carry & c1;
+      c1 ^= carry;
+
+      // Decrement the counters of the inputs that don't differ
+      carry = down & ~c0;
+      c0 ^= down;
+      c2 ^= carry & ~c1;
+      c1 ^= carry;
+
+      // Find the inputs that reached their threshold
+      byte reached = differ & ~(
+        (c0 ^ m_debthreshold[0][u]) |
+        (c1 ^ m_debthreshold[1][u]) |
+        (c2 ^ m_debthreshold[2][u]));
+
+#ifdef FISHDUINO_STATS
+      m_stats.debounceheld += __builtin_popcount(differ & ~reached);
+#endif
+
+      m_debcount[0][u] = c0 & ~reached;
+      m_debcount[1][u] = c1 & ~reached;
+      m_debcount[2][u] = c2 & ~reached;
+
+      inputs[u] = state[u] ^ reached;
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the debounce threshold of one or more inputs
+  //
+  // The threshold is the number of refreshes during which an input has to
+  // differ from its previous state (more or less: a refresh where it reads
+  // the same as before, cancels out one where it was different) before the
+  // manager reports the change. 1 means no debouncing; the maximum is
+  // MaxDebounce.
+  //
+  // Debouncing takes the same amount of time no matter how noisy the
+  // inputs are, and it happens at every refresh, so when the interface is
+  // refreshed in the background, the threshold is in timer ticks.
+  void
+  SetInputDebounce(
+    byte intindex,                      // Interface index, AllInterfaces=all
+    byte mask,                          // Input bits to change
+    byte threshold)                     // Number of refreshes, 1=off
+  {
+    threshold = constrain(threshold, 1, MaxDebounce);
+
+    // The thresholds may not match the count of UpdateInputs anymore
+    m_compatdebounce = 0;
+
+    for (byte u = 0; u < N; u++)
+    {
+      if ((u == intindex) || (intindex == AllInterfaces))
+      {
+        for (byte k = 0; k < DebounceBits; k++)
+        {
+          if (threshold & (1 << k))
+          {
+            m_debthreshold[k][u] |= mask;
+          }
+          else
+          {
+            m_debthreshold[k][u] &= ~mask;
+          }
+
+          // Start counting from 0 with the new threshold
+          m_debcount[k][u] &= ~mask;
+        }
+      }
+    }
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Store events for the inputs that changed
+  //
+  // Only the bits that changed are visited, so this takes almost no time if
+  // nothing happened.
+  void
+  DetectEdges(
+    const byte *inputs,                 // New inputs
+    const byte *previnputs)             // Inputs of the previous refresh
+  {
+    unsigned long now = 0;
+
+    for (byte u = 0; u < Count(); u++)
+    {
+      byte changed = inputs[u] ^ previnputs[u];
+
+      if (changed)
+      {
+        if (!now)
+        {
+          now = micros();
+        }
+
+        do
+        {
+          byte pin = __builtin_ctz(changed);
+
+          changed &= changed - 1;
+
+          PushEvent(now, u, pin, (inputs[u] & (1 << pin)) != 0);
+        } while (changed);
+      }
+    }
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Store an event in the queue
+  void
+  PushEvent(
+    unsigned long time,                 // Time of refresh
+    byte intindex,                      // Interface index
+    byte pin,                           // Input pin
+    bool on)                            // True=went on, false=went off
+  {
+    byte head = m_eventhead;
+    byte next = (head + 1) & (FISHDUINO_EVENT_QUEUE_SIZE - 1);
+
+    if (next == m_eventtail)
+    {
+      m_eventslost++;
+    }
+    else
+    {
+      // Don't write the entry before the tail was checked
+      FISHDUINO_BARRIER();
+
+      InputEvent &e = m_events[head];
+
+      e.time      = time;
+      e.intindex  = intindex;
+      e.pin       = pin;
+      e.on        = on;
+
+      // Make the event visible to the application only when it's complete
+      FISHDUINO_BARRIER();
+      m_eventhead = next;
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the oldest input event from the queue
+  //
+  // Events are generated every time the inputs are refreshed, so if the
+  // interface is refreshed in the background, no changes are missed even if
+  // an input goes on and off between two calls to the update functions.
+  // The time stamp is the time of the refresh that saw the change.
+  //
+  // If the application doesn't get the events often enough, the queue
+  // fills up and new events are lost; see GetEventsLost.
+  bool                                  // Returns false if queue empty
+  GetEvent(
+    InputEvent &event)                  // Receives the event
+  {
+    byte tail = m_eventtail;
+
+    if (tail == m_eventhead)
+    {
+      return false;
+    }
+
+    // Don't read the entry before the head was checked
+    FISHDUINO_BARRIER();
+
+    event = m_events[tail];
+
+    // Free the entry only after it's copied
+    FISHDUINO_BARRIER();
+    m_eventtail = (tail + 1) & (FISHDUINO_EVENT_QUEUE_SIZE - 1);
+
+    return true;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of events that were lost because the queue was full
+  unsigned                              // Returns number of lost events
+  GetEventsLost()
+  {
+    noInterrupts();
+    unsigned result = m_eventslost;
+    interrupts();
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Remove all events from the queue
+  void
+  FlushEvents()
+  {
+    noInterrupts();
+    m_eventtail = m_eventhead;
+    m_eventslost = 0;
+    interrupts();
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Copy the inputs that were read by the interrupt handler
+  //
+  // All input bytes are from the same refresh, see Snapshot.
+  void
+  FetchInputs()
+  {
+    byte inputs[N];
+
+    Snapshot(inputs);
+
+    memcpy((void *)m_inputs, inputs, Count());
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get a consistent copy of the most recent inputs of all interfaces
+  //
+  // If the interface is refreshed in the background, these are the inputs
+  // that were read by the latest Tick, even if the update functions weren't
+  // called since then. All bytes are from the same refresh: if the
+  // interrupt handler changes the inputs during the copy, they're copied
+  // again, so interrupts don't have to be disabled.
+  //
+  // If the interface isn't refreshed in the background, these are the
+  // inputs of the last call to Update or UpdateInputs.
+  void
+  Snapshot(
+    byte *inputs)                       // Receives 1 byte per interface
+  {
+    if (!m_background)
+    {
+      memcpy(inputs, (const void *)m_inputs, Count());
+      return;
+    }
+
+    byte seq;
+
+    do
+    {
+      seq = m_inputseq;
+
+      for (byte u = 0; u < Count(); u++)
+      {
+        inputs[u] = m_isrinputs[u];
+      }
+    } while ((seq & 1) || (seq != m_inputseq));
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Refresh the interface from an interrupt handler
+  //
+  // This sends the outputs to the interface and reads the inputs into a
+  // separate buffer; the main program gets them when it calls one of the
+  // update functions. The outputs are copied before they're sent, so the
+  // main program can change them at any time.
+  //
+  // See Refresh for the order in which the inputs and outputs are
+  // shifted, and what happens while an analog input is being read.
+  //
+  // Don't call the functions of the Fishduino base class that shift data
+  // to or from the interface (SetOutputs, GetInputs, Exchange) while the
+  // interface is refreshed in the background; use the update functions
+  // instead.
+  void
+  Tick()
+  {
+    Refresh(true, true);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Enable or disable background mode
+  //
+  // This is called by FishduinoTimer; you only need to call it yourself if
+  // you call Tick from your own interrupt handler. When background mode is
+  // enabled, the update functions don't access the interface anymore;
+  // Tick has to be called regularly instead.
+  void
+  SetBackground(
+    bool enable)                        // True=Tick refreshes interface
+  {
+    if (enable)
+    {
+      memcpy((void *)m_isrinputs, (const void *)m_inputs, sizeof(m_isrinputs));
+    }
+
+    m_background = enable;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the interface is refreshed in the background
+  bool                                  // Returns true=Tick refreshes
+  IsBackground()
+  {
+    return m_background;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get an analog input
+  //
+  // See Fishduino::GetAnalog. While the measurement is in progress, a
+  // background refresh only updates the outputs.
+  unsigned                              // Returns time (us)
+  GetAnalog(
+    byte index)                         // 0=X, 1=Y
+  {
+    m_analogbusy = true;
+
+    unsigned result = Fishduino::GetAnalog(index);
+
+    m_analogbusy = false;
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Start reading an analog input in the background
+  //
+  // See Fishduino::StartAnalog. Until the measurement is done, the update
+  // functions (and the background refresh) only update the outputs; the
+  // inputs keep their values.
+  void
+  StartAnalog(
+    byte index)                         // 0=X, 1=Y
+  {
+    m_analogbusy = true;
+
+    Fishduino::StartAnalog(index);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if an analog measurement is done
+  bool                                  // Returns true=result available
+  IsAnalogReady()
+  {
+    bool result = Fishduino::IsAnalogReady();
+
+    if (result)
+    {
+      m_analogbusy = false;
+    }
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Start a batch of output changes
+  //
+  // The output changes after this (including the PWM duty cycles) are
+  // collected in a separate copy of the output state, and sent to the
+  // interface together when Commit is called, so an interrupt handler that
+  // refreshes the interface never sends a combination of old and new
+  // outputs, e.g. when two motors on different interfaces have to be
+  // switched at the same time. The get functions return the state of the
+  // batch.
+  //
+  // Calls can be nested; only the outermost Commit sends the changes.
+  // The update functions send the outputs from before the batch until the
+  // changes are committed.
+  void
+  BeginUpdate()
+  {
+    if (!m_batch++)
+    {
+      // The refresh function only reads the live bank, so it can be copied
+      // without disabling interrupts
+      volatile OutputBank *bank = &m_banks[m_live ^ 1];
+
+      memcpy((void *)bank, (const void *)&m_banks[m_live], sizeof(OutputBank));
+
+      m_bank = bank;
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Make a batch of output changes take effect
+  //
+  // See BeginUpdate. The changes are used from the next refresh on.
+  void
+  Commit()
+  {
+    if ((m_batch) && (!--m_batch))
+    {
+      m_live = (m_bank == &m_banks[0]) ? 0 : 1;
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set an output bit
+  bool                                  // Returns new state of the output
+  SetOutputPin(
+    byte intindex,                      // Interface index, 0=first
+    byte pin,                           // Output pin number, 0=first(!)
+    bool value = true)                  // True=on, false=off
+  {
+    if ((intindex < N) && (pin < 7))
+    {
+      if (value)
+      {
+        m_bank->outputs[intindex] |= (1 << pin);
+      }
+      else
+      {
+        m_bank->outputs[intindex] &= ~(1 << pin);
+      }
+
+      // The output is now fully on or off
+      m_bank->pwmmask[intindex] &= ~(1 << pin);
+    }
+
+    return value;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set multiple output bits
+  void
+  SetOutputMask(
+    byte intindex,                      // Interface index, 0=first
+    byte setmask,                       // Bits to set
+    byte resetmask)                     // Bits to reset
+  {
+    volatile OutputBank &bank = *m_bank;
+
+    bank.outputs[intindex] = (bank.outputs[intindex] | setmask) & (~resetmask);
+
+    // The given outputs are now fully on or off
+    bank.pwmmask[intindex] &= ~(setmask | resetmask);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the PWM duty cycle of multiple output bits
+  //
+  // The duty cycle is scaled from 0..255 to the PWM resolution. A duty cycle
+  // of 0 turns the outputs off and a duty cycle of 255 turns them on
+  // without PWM; anything in between turns them on for part of the time
+  // but never completely off or completely on.
+  //
+  // PWM only works if the interface is refreshed often, e.g. from a timer
+  // interrupt (see FishduinoTimer.h). Setting the same outputs with
+  // SetOutputPin or SetOutputMask turns PWM off for those outputs.
+  void
+  SetOutputDuty(
+    byte intindex,                      // Interface index, 0=first
+    byte mask,                          // Bits to set
+    byte duty)                          // Duty cycle 0=off .. 255=on
+  {
+    if (intindex < N)
+    {
+      if ((duty == 0) || (duty == 255))
+      {
+        SetOutputMask(intindex, duty ? mask : 0, duty ? 0 : mask);
+      }
+      else
+      {
+        volatile OutputBank &bank = *m_bank;
+        byte level = ((unsigned)duty * PwmLevels + 128) >> 8;
+
+        level = constrain(level, 1, PwmLevels - 1);
+
+        // Set the level first, then enable PWM, so that the refresh
+        // function never sees PWM enabled with a stale level.
+        for (byte k = 0; k < PwmBits; k++)
+        {
+          if (level & (1 << k))
+          {
+            bank.pwmplane[k][intindex] |= mask;
+          }
+          else
+          {
+            bank.pwmplane[k][intindex] &= ~mask;
+          }
+        }
+
+        bank.pwmmask[intindex] |= mask;
+        bank.outputs[intindex] |= mask;
+      }
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a function that's called at every tick
+  //
+  // The function is called at the start of each tick, before the outputs
+  // are sent to the interface; if the interface is refreshed by a timer
+  // (see FishduinoTimer.h), that's at every refresh, from the interrupt
+  // handler. If you call the update functions yourself, it's called by
+  // Update and UpdateOutputs, at the tick rate (see SetTickRate).
+  //
+  // A tick handler can react to the inputs (see GetTickInputs) and change
+  // its outputs (see SetTickOutputs) without waiting for the main program.
+  // Tick and Update read the inputs before the tick handlers are called,
+  // and send the outputs right after, so that happens in one refresh.
+  // Keep it short, and don't use the other functions of the manager
+  // from it.
+  bool                                  // Returns false if too many
+  AddTickHandler(
+    TickHandler func,                   // Function to call
+    void *context)                      // Parameter for the function
+  {
+    bool result = false;
+
+    noInterrupts();
+
+    if (m_numtickhandlers < MaxTickHandlers)
+    {
+      m_tickfunc[m_numtickhandlers] = func;
+      m_tickcontext[m_numtickhandlers] = context;
+      m_numtickhandlers++;
+
+      result = true;
+    }
 
+    interrupts();
 
-/////////////////////////////////////////////////////////////////////////////
-// INCLUDES
-/////////////////////////////////////////////////////////////////////////////
+    return result;
+  }
 
+public:
+  //-------------------------------------------------------------------------
+  // Remove a tick handler
+  //
+  // The outputs of the handler stay the way it left them; use
+  // ReleaseTickOutputs to give them back to the other output functions.
+  void
+  RemoveTickHandler(
+    TickHandler func,                   // Function that was added
+    void *context)                      // Parameter that was added
+  {
+    noInterrupts();
 
-#include "FishDuino.h"
+    for (byte h = 0; h < m_numtickhandlers; h++)
+    {
+      if ((m_tickfunc[h] == func) && (m_tickcontext[h] == context))
+      {
+        m_numtickhandlers--;
 
+        for (byte i = h; i < m_numtickhandlers; i++)
+        {
+          m_tickfunc[i] = m_tickfunc[i + 1];
+          m_tickcontext[i] = m_tickcontext[i + 1];
+        }
 
-/////////////////////////////////////////////////////////////////////////////
-// FISHDUINO MANAGER
-/////////////////////////////////////////////////////////////////////////////
+        break;
+      }
+    }
 
+    interrupts();
+  }
 
-class FishduinoMgr : public Fishduino
-{
-#ifndef NDEBUG
 public:
-#else
-protected:
-#endif
-  volatile byte     m_outputs[MaxInterfaces];   // Digital outputs
-  volatile byte     m_inputs[MaxInterfaces];    // Digital inputs
-  byte              m_previnputs[MaxInterfaces];// Input cache
+  //-------------------------------------------------------------------------
+  // Set outputs from a tick handler
+  //
+  // The outputs are taken over by the tick handler: the other output
+  // functions, PWM and output sequences don't change them anymore, until
+  // ReleaseTickOutputs is called; only interlocks override them. Only call
+  // this from a tick handler (or with interrupts disabled).
+  void
+  SetTickOutputs(
+    byte intindex,                      // Interface index, 0=first
+    byte setmask,                       // Bits to set
+    byte resetmask)                     // Bits to reset
+  {
+    if (intindex < N)
+    {
+      m_tickoutputs[intindex] = (m_tickoutputs[intindex] | setmask) & ~resetmask;
+      m_tickmask[intindex] |= setmask | resetmask;
+    }
+  }
 
 public:
   //-------------------------------------------------------------------------
-  // Constructor
-  FishduinoMgr(
-    byte pin_datacountin,
-    byte pin_triggerx,
-    byte pin_triggery,
-    byte pin_dataout,
-    byte pin_clock,
-    byte pin_loadout,
-    byte pin_loadin,
-    byte num_interfaces = 1)
-  : Fishduino(
-    pin_datacountin,
-    pin_triggerx,
-    pin_triggery,
-    pin_dataout,
-    pin_clock,
-    pin_loadout,
-    pin_loadin,
-    num_interfaces)
+  // Give outputs of a tick handler back to the other output functions
+  //
+  // The outputs go back to the state that was set with the other output
+  // functions.
+  void
+  ReleaseTickOutputs(
+    byte intindex,                      // Interface index, AllInterfaces=all
+    byte mask)                          // Outputs to release
   {
-    Reset();
-    Update();
+    noInterrupts();
+
+    for (byte u = 0; u < N; u++)
+    {
+      if ((u == intindex) || (intindex == AllInterfaces))
+      {
+        m_tickmask[u] &= ~mask;
+      }
+    }
+
+    interrupts();
   }
 
 public:
   //-------------------------------------------------------------------------
-  // Simpler constructor for when connected to consecutive Arduino pins
-  FishduinoMgr(
-    byte startpin = 2,
-    byte num_interfaces = 1)
-  : Fishduino(
-    startpin,
-    num_interfaces)
+  // Get the inputs of an interface from a tick handler
+  //
+  // These are the debounced inputs of the most recent refresh, even if the
+  // main program didn't call an update function since then. In a tick
+  // handler that's called by Tick or Update, they were read in the same
+  // refresh, see Refresh.
+  byte                                  // Returns input bits, bit 0 is I1
+  GetTickInputs(
+    byte intindex)                      // Interface index, 0=first
   {
-    Reset();
-    Update();
+    byte result = 0;
+
+    if (intindex < N)
+    {
+      result = m_background ? m_isrinputs[intindex] : m_inputs[intindex];
+    }
+
+    return result;
   }
 
 public:
   //-------------------------------------------------------------------------
-  // Reset the outputs
-  void
-  Reset()
+  // Add an interlock rule
+  //
+  // At every refresh, the manager checks the given inputs; if they're in
+  // the given state, the given outputs are switched off (or on) in the
+  // same refresh, no matter what the application, the tick handlers or an
+  // output sequence set them to. E.g. to switch outputs 0 and 1 of
+  // interface 1 (motor M1) off while input I3 of interface 0 is on:
+  //
+  //   fishduino.AddInterlock(0, 0x04, 0x04, 1, 0x03);
+  //
+  // The state of the outputs that was set by the application isn't
+  // changed, so the outputs come back when the rule isn't active anymore.
+  // A latching rule stays active until ReleaseInterlocks is called, even if
+  // the inputs change back, e.g. for an emergency stop.
+  //
+  // Tick and Update read the inputs before they compose the outputs (see
+  // Refresh), so the outputs react in the same refresh in which the inputs
+  // are seen; if the interface is refreshed by a timer (see
+  // FishduinoTimer.h), that's whatever the main program is doing.
+  // UpdateOutputs doesn't read the inputs, so if you call UpdateInputs and
+  // UpdateOutputs yourself, the rules use the inputs of the last call to
+  // UpdateInputs.
+  bool                                  // Returns false if too many/invalid
+  AddInterlock(
+    byte inindex,                       // Interface index of the inputs
+    byte inmask,                        // Inputs to check
+    byte invalue,                       // State of those inputs for rule
+    byte outindex,                      // Interface index of the outputs
+    byte offmask,                       // Outputs to switch off
+    byte onmask = 0,                    // Outputs to switch on
+    bool latch = false)                 // True=stay active until released
   {
-    memset((void*)m_outputs, 0, sizeof(m_outputs));
+    bool result = false;
+
+    if ((inindex < N) && (outindex < N))
+    {
+      noInterrupts();
+
+      byte r = m_numinterlocks;
+
+      if (r < MaxInterlocks)
+      {
+        Interlock &rule = m_interlocks[r];
+
+        rule.inindex  = inindex;
+        rule.inmask   = inmask;
+        rule.invalue  = invalue & inmask;
+        rule.outindex = outindex;
+        rule.andmask  = ~offmask;
+        rule.ormask   = onmask & ~offmask;
+
+        if (latch)
+        {
+          m_interlocklatch |= 1 << r;
+        }
+        else
+        {
+          m_interlocklatch &= ~(1 << r);
+        }
+
+        m_interlocklatched &= ~(1 << r);
+        m_numinterlocks = r + 1;
+
+        result = true;
+      }
+
+      interrupts();
+    }
+
+    return result;
   }
 
 public:
   //-------------------------------------------------------------------------
-  // Update the outputs from the internal data
+  // Remove all interlock rules
   void
-  UpdateOutputs()
+  ClearInterlocks()
   {
-    SetOutputs((const byte *)m_outputs);
+    noInterrupts();
+    m_numinterlocks = 0;
+    m_interlocklatched = 0;
+    m_interlockactive = 0;
+    interrupts();
   }
 
 public:
   //-------------------------------------------------------------------------
-  // Update the internal data from the inputs
+  // Release latched interlock rules
   //
-  // If the debounce count is given, the function keeps reading the inputs
-  // until it gets the same readings 
+  // Rules of which the inputs are still in the given state stay active.
   void
-  UpdateInputs(
-    unsigned debouncecount = 0,         // Need this many identical readings
-    unsigned delayus = 0)               // Delay between readings (useconds)
+  ReleaseInterlocks()
   {
-    unsigned counter = 0;
-    byte curinputs[MaxInterfaces];
-    bool init = false;
+    noInterrupts();
+    m_interlocklatched = 0;
+    interrupts();
+  }
 
-    memcpy(m_previnputs, (const void *)m_inputs, sizeof(m_previnputs));
+public:
+  //-------------------------------------------------------------------------
+  // Get the interlock rules that were active at the last refresh
+  //
+  // Bit n is set if rule n (in the order they were added) was active.
+  byte                                  // Returns active rules
+  GetActiveInterlocks()
+  {
+    return m_interlockactive;
+  }
 
-    for (;;)
+public:
+  //-------------------------------------------------------------------------
+  // Play an output sequence from flash memory
+  //
+  // The sequence is an array of Step structures in PROGMEM, see above. The
+  // steps are timed by the ticks: the manager goes to the next step when
+  // the current one has lasted the given number of ticks. If the interface
+  // is refreshed by a timer (see FishduinoTimer.h), every refresh is a
+  // tick, so e.g. at 1000 refreshes per second, a step of 10 ticks takes
+  // 10ms. If you call the update functions yourself, Update and
+  // UpdateOutputs advance the sequence at the tick rate (see SetTickRate),
+  // no matter how often they're called.
+  //
+  // The sequence is played the given number of times (0 means forever),
+  // and then the chained sequence is started (see ChainSequence), or the
+  // sequence stops. While the sequence plays, the outputs that it controls
+  // (see SetSequenceMask) ignore the other output functions; afterwards,
+  // they go back to the state that was set with those functions. Outputs
+  // that were taken over by a tick handler (see SetTickOutputs) and
+  // interlocks (see AddInterlock) still override the sequence.
+  //
+  // If another sequence was playing, it's replaced immediately. If the
+  // sequence is NULL, this stops the sequence that's playing.
+  void
+  PlaySequence(
+    const Step *seq,                    // Steps in PROGMEM, NULL=stop
+    byte repeat = 1)                    // Number of times, 0=forever
+  {
+    if (!seq)
     {
-      GetInputs((byte *)m_inputs);
+      StopSequence();
+      return;
+    }
 
-      if (counter >= debouncecount)
-      {
-        break;
-      }
+    uint16_t ticks = pgm_read_word(&seq->ticks);
 
-      if ((init) && (!memcmp(curinputs, (const void *)m_inputs, sizeof(curinputs))))
-      {
-        ++counter;
-      }
-      else
-      {
-        memcpy(curinputs, (const void *)m_inputs, sizeof(curinputs));
-        counter = 0;
-        init = true;
-      }
+    noInterrupts();
+    m_seqstep = seq;
+    m_seqticks = ticks;
+    m_seqrepeat = repeat;
+    m_seqnext = NULL;
+    m_seq = ticks ? seq : NULL;
+    interrupts();
+  }
 
-      if (delayus)
-      {
-        delayMicroseconds(delayus);
-      }
+public:
+  //-------------------------------------------------------------------------
+  // Play an output sequence after the current one
+  //
+  // The sequence starts at the refresh after the last step of the current
+  // sequence (after all repeats), so there's no gap. This replaces any
+  // sequence that was chained before, and if no sequence is playing, the
+  // sequence is started right away. The chained sequence can chain
+  // another one, once it's started.
+  void
+  ChainSequence(
+    const Step *seq,                    // Steps in PROGMEM
+    byte repeat = 1)                    // Number of times, 0=forever
+  {
+    noInterrupts();
+
+    if (m_seq)
+    {
+      m_seqnext = seq;
+      m_seqnextrepeat = repeat;
+      interrupts();
+    }
+    else
+    {
+      interrupts();
+      PlaySequence(seq, repeat);
     }
   }
 
 public:
   //-------------------------------------------------------------------------
-  // Update the outputs and inputs
+  // Stop the output sequence
+  //
+  // The outputs go back to the state that was set with the other output
+  // functions.
   void
-  Update()
+  StopSequence()
   {
-    UpdateOutputs();
-    UpdateInputs();
+    noInterrupts();
+    m_seq = NULL;
+    m_seqnext = NULL;
+    interrupts();
   }
 
 public:
   //-------------------------------------------------------------------------
-  // Set an output bit
-  bool                                  // Returns new state of the output
-  SetOutputPin(
-    byte intindex,                      // Interface index, 0=first
-    byte pin,                           // Output pin number, 0=first(!)
-    bool value = true)                  // True=on, false=off
+  // Check if an output sequence is playing
+  bool                                  // Returns true=playing
+  IsSequencePlaying()
   {
-    if ((intindex < MaxInterfaces) && (pin < 7))
-    {
-      if (value)
-      {
-        m_outputs[intindex] |= (1 << pin);
-      }
-      else
-      {
-        m_outputs[intindex] &= ~(1 << pin);
-      }
-    }
-
-    return value;
+    return m_seq != NULL;
   }
 
 public:
   //-------------------------------------------------------------------------
-  // Set multiple output bits
+  // Set which outputs are controlled by output sequences
+  //
+  // By default, a sequence controls all outputs. The other outputs can be
+  // controlled with the other output functions while a sequence plays.
   void
-  SetOutputMask(
-    byte intindex,                      // Interface index, 0=first
-    byte setmask,                       // Bits to set
-    byte resetmask)                     // Bits to reset
+  SetSequenceMask(
+    byte intindex,                      // Interface index, AllInterfaces=all
+    byte mask)                          // Outputs controlled by sequence
   {
-    m_outputs[intindex] = (m_outputs[intindex] | setmask) & (~resetmask);
+    for (byte u = 0; u < N; u++)
+    {
+      if ((u == intindex) || (intindex == AllInterfaces))
+      {
+        m_seqmask[u] = mask;
+      }
+    }
   }
 
 
@@ -233,7 +1959,7 @@ public:
   {
     bool result = false;
 
-    if ((intindex < MaxInterfaces) && (pin < 7))
+    if ((intindex < N) && (pin < 7))
     {
       result = (0 != (m_inputs[intindex] & (1 << pin)));
     }
@@ -251,7 +1977,7 @@ public:
   {
     bool result = false;
 
-    if ((intindex < MaxInterfaces) && (pin < 7))
+    if ((intindex < N) && (pin < 7))
     {
       result = (0 != (m_previnputs[intindex] & (1 << pin)));
     }
@@ -268,7 +1994,7 @@ public:
   {
     byte result = 0;
 
-    if (intindex < MaxInterfaces)
+    if (intindex < N)
     {
       result = m_inputs[intindex];
     }
@@ -285,7 +2011,7 @@ public:
   {
     byte result = 0;
 
-    if (intindex < MaxInterfaces)
+    if (intindex < N)
     {
       result = m_previnputs[intindex];
     }
@@ -303,9 +2029,9 @@ public:
   {
     bool result = false;
 
-    if ((intindex < MaxInterfaces) && (pin < 7))
+    if ((intindex < N) && (pin < 7))
     {
-      result = (0 != (m_outputs[intindex] & (1 << pin)));
+      result = (0 != (m_bank->outputs[intindex] & (1 << pin)));
     }
 
     return result;
@@ -320,9 +2046,87 @@ public:
   {
     byte result = 0;
 
-    if (intindex < MaxInterfaces)
+    if (intindex < N)
+    {
+      result = m_bank->outputs[intindex];
+    }
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the inputs of four interfaces as a word
+  //
+  // See NumWords. Bit 0 is input I1 of interface 4 * wordindex.
+  uint32_t                              // Returns state as bit pattern
+  GetInputWord(
+    byte wordindex)                     // Word index, 0=interfaces 0-3
+  {
+    uint32_t result = 0;
+
+    if (wordindex < NumWords)
+    {
+      result = m_inwords[wordindex];
+    }
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the previous inputs of four interfaces as a word
+  uint32_t                              // Returns state as bit pattern
+  GetPrevInputWord(
+    byte wordindex)                     // Word index, 0=interfaces 0-3
+  {
+    uint32_t result = 0;
+
+    if (wordindex < NumWords)
+    {
+      result = m_previnwords[wordindex];
+    }
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set multiple output bits on up to four interfaces
+  //
+  // This is the same as SetOutputMask, for four interfaces at once. On an
+  // 8-bit processor, the word is written one byte at a time, so if the
+  // interface is refreshed in the background, use BeginUpdate and Commit
+  // to make sure all interfaces change in the same refresh.
+  void
+  SetOutputWord(
+    byte wordindex,                     // Word index, 0=interfaces 0-3
+    uint32_t setmask,                   // Bits to set
+    uint32_t resetmask)                 // Bits to reset
+  {
+    if (wordindex < NumWords)
+    {
+      volatile OutputBank &bank = *m_bank;
+
+      bank.outwords[wordindex] = (bank.outwords[wordindex] | setmask) & ~resetmask;
+
+      // The given outputs are now fully on or off
+      bank.pwmwords[wordindex] &= ~(setmask | resetmask);
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the outputs of four interfaces as a word
+  uint32_t                              // Returns state as bit pattern
+  GetOutputWord(
+    byte wordindex)                     // Word index, 0=interfaces 0-3
+  {
+    uint32_t result = 0;
+
+    if (wordindex < NumWords)
     {
-      result = m_outputs[intindex];
+      result = m_bank->outwords[wordindex];
     }
 
     return result;
@@ -330,6 +2134,51 @@ public:
 };
 
 
+/////////////////////////////////////////////////////////////////////////////
+// COMPATIBLE FISHDUINO MANAGER
+/////////////////////////////////////////////////////////////////////////////
+
+
+class FishduinoMgr : public FishduinoMgrN<Fishduino::MaxInterfaces, false>
+{
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  FishduinoMgr(
+    byte pin_datacountin,
+    byte pin_triggerx,
+    byte pin_triggery,
+    byte pin_dataout,
+    byte pin_clock,
+    byte pin_loadout,
+    byte pin_loadin,
+    byte num_interfaces = 1)
+  : FishduinoMgrN<Fishduino::MaxInterfaces, false>(
+    pin_datacountin,
+    pin_triggerx,
+    pin_triggery,
+    pin_dataout,
+    pin_clock,
+    pin_loadout,
+    pin_loadin,
+    num_interfaces)
+  {
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Simpler constructor for when connected to consecutive Arduino pins
+  FishduinoMgr(
+    byte startpin = 2,
+    byte num_interfaces = 1)
+  : FishduinoMgrN<Fishduino::MaxInterfaces, false>(
+    startpin,
+    num_interfaces)
+  {
+  }
+};
+
+
 /////////////////////////////////////////////////////////////////////////////
 // END
 /////////////////////////////////////////////////////////////////////////////
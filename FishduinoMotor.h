@@ -59,14 +59,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /////////////////////////////////////////////////////////////////////////////
 
 
-class FishduinoMotor
+template <class MGR = FishduinoMgr>
+class FishduinoMotorT
 {
 #ifndef NDEBUG
 public:
 #else
 protected:
 #endif
-  FishduinoMgr   &m_mgr;                // Manager to work with
+  MGR            &m_mgr;                // Manager to work with
   byte            m_intindex;           // Interface index
   byte            m_ccwmask;            // Bits for counterclockwise
   byte            m_cwmask;             // Bits for clockwise
@@ -97,8 +98,8 @@ public:
   // Note: the counter-clockwise pin is usually the lower pin (even pin
   // numbers in our numbering scheme) and the clockwise pin is usually one
   // pin higher.
-  FishduinoMotor(
-    FishduinoMgr &mgr,                  // Manager to work with
+  FishduinoMotorT(
+    MGR &mgr,                           // Manager to work with
     byte intindex,                      // Interface index
     byte ccwpin,                        // Pin to set for counter-clockwise
     byte cwpin = 255)                   // Pin to set for clockwise(255=next)
@@ -150,11 +151,15 @@ public:
   //-------------------------------------------------------------------------
   // Start the motor in the given direction
   //
+  // The speed is the PWM duty cycle (see FishduinoMgr::SetOutputDuty);
+  // 255 is full speed without PWM.
+  //
   // Note: this doesn't actually update the outputs, you need to call the
   // appropriate update function on the manager for that.
   void
   Rotate(
-    Direction dir)
+    Direction dir,
+    byte speed = 255)                   // Speed, 0=stopped .. 255=full
   {
     byte m;
 
@@ -171,7 +176,9 @@ public:
       m = 0;
     }
 
-    m_mgr.SetOutputMask(m_intindex, m, (m_ccwmask | m_cwmask) ^ m);
+    // Turn the other direction off before turning this direction on
+    m_mgr.SetOutputMask(m_intindex, 0, (m_ccwmask | m_cwmask) ^ m);
+    m_mgr.SetOutputDuty(m_intindex, m, speed);
   }
 
 public:
@@ -201,6 +208,11 @@ public:
 };
 
 
+// Motor on an interface of the compatible manager. For other managers,
+// use FishduinoMotorT<> with the type of the manager, see FishduinoMgr.h.
+typedef FishduinoMotorT<> FishduinoMotor;
+
+
 /////////////////////////////////////////////////////////////////////////////
 // END
 /////////////////////////////////////////////////////////////////////////////
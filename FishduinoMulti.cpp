@@ -0,0 +1,328 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+#include <Arduino.h>
+
+#include "FishduinoMulti.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Add a chain
+bool                                  // Returns false if too many chains
+FishduinoMulti::AddChain(
+  Fishduino &chain)                   // Chain to add
+{
+  if (m_num_chains >= MaxChains)
+  {
+    return false;
+  }
+
+  m_chain[m_num_chains++] = &chain;
+
+  // Find out if the chains can be shifted in lockstep, and if so, whether
+  // the data pins of all chains can be accessed with one port access.
+  Fishduino *first = m_chain[0];
+
+  m_lockstep = true;
+  m_parallel = true;
+
+#ifdef __AVR__
+  uint8_t inmask = 0;
+
+  m_outreg  = first->m_reg[Fishduino::DATAOUT];
+  m_inreg   = first->m_reg[Fishduino::DATACOUNTIN];
+  m_outmask = 0;
+#endif
+
+  for (byte c = 0; c < m_num_chains; c++)
+  {
+    Fishduino *f = m_chain[c];
+
+    if ((f->m_pin[Fishduino::CLOCK]   != first->m_pin[Fishduino::CLOCK])
+     || (f->m_pin[Fishduino::LOADOUT] != first->m_pin[Fishduino::LOADOUT])
+     || (f->m_pin[Fishduino::LOADIN]  != first->m_pin[Fishduino::LOADIN]))
+    {
+      m_lockstep = false;
+    }
+
+#ifdef __AVR__
+    if ((f->m_reg[Fishduino::DATAOUT] != m_outreg)
+     || (f->m_reg[Fishduino::DATACOUNTIN] != m_inreg)
+     || (f->m_bit[Fishduino::DATAOUT] & m_outmask)
+     || (f->m_bit[Fishduino::DATACOUNTIN] & inmask))
+    {
+      m_parallel = false;
+    }
+
+    m_outmask |= f->m_bit[Fishduino::DATAOUT];
+    inmask    |= f->m_bit[Fishduino::DATACOUNTIN];
+#else
+    m_parallel = false;
+#endif
+  }
+
+  m_parallel = m_parallel && m_lockstep;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Reset all chains
+bool                                  // Returns True=success False=failure
+FishduinoMulti::Reset()
+{
+  bool result = true;
+
+  for (byte c = 0; c < m_num_chains; c++)
+  {
+    if (!m_chain[c]->Reset(m_chain[c]->m_num_interfaces))
+    {
+      result = false;
+    }
+  }
+
+  Exchange(NULL, NULL);
+
+  return result;
+}
+
+
+//---------------------------------------------------------------------------
+// Put the next data bit of each chain on its DATA OUT pin
+void
+FishduinoMulti::WriteBits(
+  byte *bits)                         // Bit 7 is sent, shifted left
+{
+#ifdef __AVR__
+  if (m_parallel)
+  {
+    uint8_t value = 0;
+
+    for (byte c = 0; c < m_num_chains; c++)
+    {
+      if (bits[c] & 0x80)
+      {
+        value |= m_chain[c]->m_bit[Fishduino::DATAOUT];
+      }
+
+      bits[c] <<= 1;
+    }
+
+    // Same as Fishduino::PinWrite, but for all chains at once
+    uint8_t oldsreg = SREG;
+
+    cli();
+
+    *m_outreg = (*m_outreg & ~m_outmask) | value;
+
+    SREG = oldsreg;
+
+    return;
+  }
+#endif
+
+  for (byte c = 0; c < m_num_chains; c++)
+  {
+    m_chain[c]->PinWrite(Fishduino::DATAOUT, (bits[c] & 0x80) != 0);
+
+    bits[c] <<= 1;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Read the data bit of each chain from its DATA/COUNT IN pin
+void
+FishduinoMulti::ReadBits(
+  byte *data)                         // Bit is shifted in at the right
+{
+#ifdef __AVR__
+  if (m_parallel)
+  {
+    uint8_t value = *m_inreg;
+
+    for (byte c = 0; c < m_num_chains; c++)
+    {
+      data[c] = (data[c] << 1) | !(value & m_chain[c]->m_bit[Fishduino::DATACOUNTIN]);
+    }
+
+    return;
+  }
+#endif
+
+  for (byte c = 0; c < m_num_chains; c++)
+  {
+    data[c] = (data[c] << 1) | !m_chain[c]->PinRead(Fishduino::DATACOUNTIN);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Set the outputs and read the inputs of all chains
+void
+FishduinoMulti::Exchange(
+  const byte *const *outvalues,       // 1 entry per chain (NULL=reset)
+  byte *const *invalues)              // 1 entry per chain (or NULL)
+{
+  if (!m_num_chains)
+  {
+    return;
+  }
+
+  if (!m_lockstep)
+  {
+    // Each chain has its own clock, so shift them one after the other
+    for (byte c = 0; c < m_num_chains; c++)
+    {
+      m_chain[c]->Exchange(
+        outvalues ? outvalues[c] : NULL,
+        invalues ? invalues[c] : NULL);
+    }
+
+    return;
+  }
+
+  // The shared lines are controlled through the first chain
+  Fishduino *first = m_chain[0];
+
+#ifdef FISHDUINO_STATS
+  unsigned long start = micros();
+#endif
+
+  // Shift enough bits for the longest chain. Same as Fishduino: if NULL
+  // is passed, clear all possible interfaces.
+  byte num = outvalues ? 1 : Fishduino::MaxInterfaces;
+
+  for (byte c = 0; c < m_num_chains; c++)
+  {
+    if (m_chain[c]->m_num_interfaces > num)
+    {
+      num = m_chain[c]->m_num_interfaces;
+    }
+  }
+
+  byte bits[MaxChains];
+  byte data[MaxChains];
+
+  first->PinWrite(Fishduino::LOADOUT, LOW);
+
+  // The first rising edge of the clock loads the inputs
+  if (invalues)
+  {
+    first->PinWrite(Fishduino::LOADIN, HIGH);
+  }
+
+  for (byte v = 0; v < num; v++)
+  {
+    // Get the next output byte for each chain. The last byte goes to the
+    // first interface; chains that are shorter than the longest chain get
+    // zeroes first, which fall off the end of the chain.
+    byte index = num - 1 - v;
+
+    for (byte c = 0; c < m_num_chains; c++)
+    {
+      const byte *p = outvalues ? outvalues[c] : NULL;
+
+      bits[c] = ((p) && (index < m_chain[c]->m_num_interfaces)) ? p[index] : 0;
+    }
+
+    for (byte u = 0; u < 8; u++)
+    {
+      first->PinWrite(Fishduino::CLOCK, LOW);
+
+      WriteBits(bits);
+
+      // Read the input bits while CLOCK is LOW, see Fishduino::Shift
+      if ((invalues) && (v | u))
+      {
+        ReadBits(data);
+
+        // If this was the last bit of an input byte, store it
+        if (!u)
+        {
+          for (byte c = 0; c < m_num_chains; c++)
+          {
+            if ((invalues[c]) && (v - 1 < m_chain[c]->m_num_interfaces))
+            {
+              invalues[c][v - 1] = data[c];
+            }
+          }
+        }
+      }
+
+      first->PinWrite(Fishduino::CLOCK, HIGH);
+
+      // After the first clock pulse, switch the input shift registers to
+      // serial mode
+      if ((invalues) && !(v | u))
+      {
+        first->PinWrite(Fishduino::LOADIN, LOW);
+      }
+    }
+  }
+
+  // Latch the outputs of all chains
+  first->PinWrite(Fishduino::LOADOUT, HIGH);
+  first->PinWrite(Fishduino::LOADOUT, LOW);
+
+  if (invalues)
+  {
+    // Read the last input bit
+    ReadBits(data);
+
+    for (byte c = 0; c < m_num_chains; c++)
+    {
+      if ((invalues[c]) && (num - 1 < m_chain[c]->m_num_interfaces))
+      {
+        invalues[c][num - 1] = data[c];
+      }
+    }
+
+    // Shift the last input bit out, so that the analog inputs can be read
+    first->PinWrite(Fishduino::CLOCK, LOW);
+    first->PinWrite(Fishduino::CLOCK, HIGH);
+  }
+
+#ifdef FISHDUINO_STATS
+  // Each chain was refreshed
+  for (byte c = 0; c < m_num_chains; c++)
+  {
+    m_chain[c]->StatsLatched();
+    m_chain[c]->StatsTime(m_chain[c]->m_stats.refresh, start);
+  }
+#endif
+}
@@ -0,0 +1,219 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  This module drives several independent chains of interfaces at the same
+  time. Each chain is a Fishduino object with its own DATA OUT and DATA/
+  COUNT IN pins (and its own TRIGGER X/Y pins for the analog inputs).
+
+  If all chains share the same CLOCK, LOAD OUT and LOAD IN pins, the chains
+  are shifted in lockstep: every clock pulse shifts one bit into and out of
+  every chain. On AVR, if the DATA OUT pins of all chains are on the same
+  port, and the DATA/COUNT IN pins of all chains are on the same port, the
+  data bits of all chains are written with a single port write and read
+  with a single port read ("bit-parallel" mode). So refreshing three chains
+  takes about as long as refreshing one.
+
+  Otherwise, each chain is shifted by its own Fishduino object, one after
+  the other.
+
+  Example for an Uno, with two chains on PORTD that share pins 6, 7 and 8:
+
+    //            DCI TX  TY  DO CLK LO  LI
+    Fishduino left( 2, 9,  10, 4, 6,  7,  8);
+    Fishduino right(3, 11, 12, 5, 6,  7,  8);
+    FishduinoMulti multi;
+
+    void setup()
+    {
+      multi.AddChain(left);
+      multi.AddChain(right);
+      multi.Reset();
+    }
+
+    void loop()
+    {
+      byte leftout[1], rightout[1], leftin[1], rightin[1];
+      const byte *out[] = { leftout, rightout };
+      byte *in[] = { leftin, rightin };
+      ...
+      multi.Exchange(out, in);
+    }
+
+  In lockstep, the chains are shifted by bit-banging, even if UseSPI was
+  called on one of them. The analog inputs are read with the Fishduino
+  object of each chain; don't use the shift functions of those objects
+  directly while the chains are in lockstep, because every clock pulse and
+  every output latch pulse reaches all the chains.
+*/
+
+
+#ifndef _FISHDUINOMULTI_H_
+#define _FISHDUINOMULTI_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Fishduino.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MULTI-CHAIN DRIVER
+/////////////////////////////////////////////////////////////////////////////
+
+
+class FishduinoMulti
+{
+public:
+  // Miscellaneous constants
+  enum
+  {
+    MaxChains = 4,                      // Max number of chains supported
+  };
+
+protected:
+  Fishduino        *m_chain[MaxChains]; // Chains to drive
+  byte              m_num_chains;       // Number of chains added
+  bool              m_lockstep;         // True=shared CLOCK and LOAD lines
+  bool              m_parallel;         // True=data pins on same ports
+
+#ifdef __AVR__
+  // Port registers of the DATA OUT and DATA/COUNT IN pins in bit-parallel
+  // mode, and the bits of all DATA OUT pins together
+  volatile uint8_t *m_outreg;           // PORTx register for DATA OUT
+  volatile uint8_t *m_inreg;            // PINx register for DATA/COUNT IN
+  uint8_t           m_outmask;          // DATA OUT bits of all chains
+#endif
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  FishduinoMulti()
+    : m_num_chains(0)
+    , m_lockstep(false)
+    , m_parallel(false)
+  {
+    // Nothing to do here
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a chain
+  //
+  // The chains are numbered in the order in which they're added, starting
+  // at 0. The Fishduino object must stay alive as long as this object uses
+  // it.
+  bool                                  // Returns false if too many chains
+  AddChain(
+    Fishduino &chain);                  // Chain to add
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the chains are shifted in lockstep
+  bool                                  // Returns true=shared clock
+  IsLockstep()
+  {
+    return m_lockstep;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the data bits of all chains are shifted with one port access
+  bool                                  // Returns true=bit-parallel
+  IsParallel()
+  {
+    return m_parallel;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Reset all chains
+  //
+  // This resets each chain with the number of interfaces it's configured
+  // for, and then clears the outputs of all chains. Call this after adding
+  // the chains: when the chains share their CLOCK and LOAD OUT lines, the
+  // reset of one chain may have latched bogus outputs on the others.
+  bool                                  // Returns True=success False=failure
+  Reset();
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the outputs and read the inputs of all chains
+  //
+  // The arrays have one entry per chain, and each entry points to the
+  // bytes for the interfaces of that chain, in the same format as for
+  // Fishduino::Exchange. The chains may have different numbers of
+  // interfaces; in lockstep, the shorter chains get some extra bits that
+  // fall off the end of the chain.
+  //
+  // If the output array is NULL, all outputs of all chains are cleared; a
+  // NULL entry clears the outputs of one chain. If the input array is NULL,
+  // the inputs aren't read; a NULL entry skips the inputs of one chain.
+  void
+  Exchange(
+    const byte *const *outvalues,       // 1 entry per chain (NULL=reset)
+    byte *const *invalues);             // 1 entry per chain (or NULL)
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the outputs of all chains
+  void
+  SetOutputs(
+    const byte *const *values)          // 1 entry per chain (NULL=reset)
+  {
+    Exchange(values, NULL);
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Put the next data bit of each chain on its DATA OUT pin
+  void
+  WriteBits(
+    byte *bits);                        // Bit 7 is sent, shifted left
+
+protected:
+  //-------------------------------------------------------------------------
+  // Read the data bit of each chain from its DATA/COUNT IN pin
+  void
+  ReadBits(
+    byte *data);                        // Bit is shifted in at the right
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
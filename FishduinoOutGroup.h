@@ -0,0 +1,222 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  This module represents a group of output pins on up to four cascaded
+  FischerTechnik interfaces.
+
+  The group has a 32-bit mask in which each byte corresponds to one
+  interface (see FishduinoMgrN::NumWords), so the pins of a group can be
+  set or reset with one masked word operation, no matter how many
+  interfaces they're on. For example, for the lamps on O1 of interface 0
+  and O5 of interface 1:
+
+    FishduinoOutGroup lamps(fishduino,
+      FishduinoOutGroup::Bit(0, FishduinoOutGroup::O1) |
+      FishduinoOutGroup::Bit(1, FishduinoOutGroup::O5));
+
+    lamps.Set(true);
+
+  All pins of a group must be on the same four interfaces: 0-3 (word 0),
+  4-7 (word 1) etc. If the interfaces are refreshed in the background, use
+  FishduinoMgr::BeginUpdate and Commit around Set to make sure that all
+  interfaces change in the same refresh.
+
+  IMPORTANT: These store a reference to a Fishduino manager, but there is no
+  code to guard against orphaning this reference. Make sure you don't call
+  any of the member functions after the manager is destroyed!
+
+  NOTE: These only set the bits in an Fishduino manager, they don't update
+  the actual interface outputs; you have to call the appropriate function in
+  the manager to do that.
+*/
+
+
+#ifndef _FISHDUINOOUTGROUP_H_
+#define _FISHDUINOOUTGROUP_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// OUTPUT GROUPS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Output Group
+//
+// An instance of this type can be used to set and reset output pins on
+// several interfaces at once.
+template <class MGR = FishduinoMgr>
+class FishduinoOutGroupT
+{
+#ifndef NDEBUG
+public:
+#else
+protected:
+#endif
+  MGR            &m_mgr;                // Manager to work with
+  byte            m_wordindex;          // Word index, 0=interfaces 0-3
+  uint32_t        m_mask;               // Bits to set/reset
+
+public:
+  //-------------------------------------------------------------------------
+  // Constants for better readability
+  //
+  // Use these as pin number to connect a device to the corresponding output
+  // pin.
+  enum {
+    O1 = 0,
+    O2,
+    O3,
+    O4,
+    O5,
+    O6,
+    O7,
+    O8,
+
+    // For those who don't like to use the letter O as identifier:...
+    Q1 = 0,
+    Q2,
+    Q3,
+    Q4,
+    Q5,
+    Q6,
+    Q7,
+    Q8,
+  };
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the bit in a group mask for a pin
+  static uint32_t                       // Returns mask with one bit set
+  Bit(
+    byte intindex,                      // Interface index
+    byte pin)                           // Pin number (0..7)
+  {
+    return 1UL << (((intindex & 3) << 3) + pin);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor based on a mask
+  FishduinoOutGroupT(
+    MGR &mgr,                           // Manager to work with
+    uint32_t mask,                      // Bits, see Bit
+    byte wordindex = 0)                 // Word index, 0=interfaces 0-3
+    : m_mgr(mgr)
+    , m_wordindex(wordindex)
+    , m_mask(mask)
+  {
+    // Nothing to do here
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a pin to the mask
+  void
+  AddPin(
+    byte intindex,                      // Interface index
+    byte pin)                           // Pin to add
+  {
+    m_mask |= Bit(intindex, pin);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Remove a pin from the mask
+  void
+  RemovePin(
+    byte intindex,                      // Interface index
+    byte pin)                           // Pin to remove
+  {
+    m_mask &= ~Bit(intindex, pin);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set these bits on the interfaces
+  //
+  // Note: this doesn't actually update the outputs, you need to call the
+  // appropriate update function on the manager for that.
+  void
+  Set(
+    bool value)                         // True=high, false=low
+  {
+    m_mgr.SetOutputWord(m_wordindex, value ? m_mask : 0, value ? 0 : m_mask);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the PWM duty cycle of these bits
+  //
+  // See FishduinoMgr::SetOutputDuty. The duty levels are stored per
+  // interface, so this sets them one interface at a time.
+  //
+  // Note: this doesn't actually update the outputs, you need to call the
+  // appropriate update function on the manager for that, or refresh the
+  // interface from a timer interrupt.
+  void
+  SetDuty(
+    byte duty)                          // Duty cycle 0=off .. 255=on
+  {
+    for (byte u = 0; u < 4; u++)
+    {
+      byte mask = (byte)(m_mask >> (u << 3));
+
+      if (mask)
+      {
+        m_mgr.SetOutputDuty((m_wordindex << 2) + u, mask, duty);
+      }
+    }
+  }
+};
+
+
+// Output group on the interfaces of the compatible manager. For other
+// managers, use FishduinoOutGroupT<> with the type of the manager, see
+// FishduinoMgr.h.
+typedef FishduinoOutGroupT<> FishduinoOutGroup;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
@@ -64,14 +64,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 // An instance of this type can be used to set and reset multiple output
 // pins at once.
-class FishduinoOutPin
+template <class MGR = FishduinoMgr>
+class FishduinoOutPinT
 {
 #ifndef NDEBUG
 public:
 #else
 protected:
 #endif
-  FishduinoMgr   &m_mgr;                // Manager to work with
+  MGR            &m_mgr;                // Manager to work with
   byte            m_intindex;           // Interface index
   byte            m_mask;               // Bits to set/reset
 
@@ -105,8 +106,8 @@ public:
 public:
   //-------------------------------------------------------------------------
   // Constructor based on single bit
-  FishduinoOutPin(
-    FishduinoMgr &mgr,                  // Manager to work with
+  FishduinoOutPinT(
+    MGR &mgr,                           // Manager to work with
     byte intindex,                      // Interface index
     byte pin)                           // Pin number (0..7)
     : m_mgr(mgr)
@@ -148,9 +149,31 @@ public:
   {
     m_mgr.SetOutputMask(m_intindex, value ? m_mask : 0, value ? 0 : m_mask);
   }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the PWM duty cycle of these bits
+  //
+  // 0 is off, 255 is on, anything in between dims the lamp or slows down
+  // the motor that's connected. See FishduinoMgr::SetOutputDuty.
+  //
+  // Note: this doesn't actually update the outputs, you need to call the
+  // appropriate update function on the manager for that, or refresh the
+  // interface from a timer interrupt.
+  void
+  SetDuty(
+    byte duty)                          // Duty cycle 0=off .. 255=on
+  {
+    m_mgr.SetOutputDuty(m_intindex, m_mask, duty);
+  }
 };
 
 
+// Output pin(s) on an interface of the compatible manager. For other managers,
+// use FishduinoOutPinT<> with the type of the manager, see FishduinoMgr.h.
+typedef FishduinoOutPinT<> FishduinoOutPin;
+
+
 /////////////////////////////////////////////////////////////////////////////
 // END
 /////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,581 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  This module represents a motor with an impulse switch on a FischerTechnik
+  interface, used as a positioning axis.
+
+  The switch is closed and opened by a cam or impulse wheel on the axis,
+  so the position is the number of times that the switch changed state.
+  The edges are counted at every tick of the manager (see
+  FishduinoMgrN::AddTickHandler). The manager reads the inputs before it
+  runs the tick handlers (see FishduinoMgrN::Refresh), so the motor is
+  switched off in the same refresh that the edge arrives on which it
+  should stop, and the main program doesn't have to poll the switch:
+
+    #include <FishduinoTimer.h>
+    #include <FishduinoServoAxis.h>
+
+    FishduinoMgr fishduino;
+    FishduinoServoAxis axis(fishduino, 0, FishduinoServoAxis::M1,
+      FishduinoServoAxis::I1);
+
+    void setup()
+    {
+      FishduinoTimer::Begin(fishduino, 1000);
+      axis.Begin();
+      axis.MoveTo(20);
+    }
+
+  A motor doesn't stop right away when it's switched off; it coasts a
+  little, more so when it runs faster. The axis measures the time between
+  edges, and learns how many edges the motor coasts after it's switched
+  off at a given speed. On the next moves, it switches the motor off that
+  many edges early. If the motor still stops on the wrong edge, it moves
+  back to the target a few times at most.
+
+  The position counts up when the motor runs clockwise. If the interface
+  is refreshed by the update functions instead of a timer, the axis only
+  runs when Update or UpdateOutputs starts a tick (see
+  FishduinoMgrN::SetTickRate), and only sees the inputs of the last call
+  to Update or UpdateInputs. Call Update at least at the tick rate, and
+  make sure the tick rate is more than twice the edge rate of the switch
+  at full speed, or edges will be missed. Inputs that are read by
+  UpdateInputs are only acted upon at the next tick.
+
+  IMPORTANT: These store a reference to a Fishduino manager, but there is no
+  code to guard against orphaning this reference. Make sure you don't call
+  any of the member functions after the manager is destroyed, and call End
+  before an axis object is destroyed!
+*/
+
+
+#ifndef _FISHDUINOSERVOAXIS_H_
+#define _FISHDUINOSERVOAXIS_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SERVO AXIS
+/////////////////////////////////////////////////////////////////////////////
+
+
+template <class MGR = FishduinoMgr>
+class FishduinoServoAxisT
+{
+public:
+  //-------------------------------------------------------------------------
+  // Constants for better readability
+  //
+  // Same as for FishduinoMotorT and FishduinoInPinT.
+  enum {
+    M1 = 0,
+    M2 = 2,
+    M3 = 4,
+    M4 = 6
+  };
+
+  enum {
+    I1 = 0,
+    I2,
+    I3,
+    I4,
+    I5,
+    I6,
+    I7,
+    I8
+  };
+
+  // Defaults
+  enum {
+    DefaultStallTicks = 1000,           // Refreshes without edge=stalled
+    MinSettleTicks = 20,                // Refreshes without edge=stopped
+    MaxRetries = 3,                     // Moves to correct the position
+    CoastScale = 16,                    // Fraction of coast distance
+  };
+
+  // State of the axis
+  enum State {
+    Idle,                               // Motor off and stopped
+    Moving,                             // Motor on
+    Settling,                           // Motor off but maybe still moving
+    Stalled                             // No edges while motor on
+  };
+
+#ifndef NDEBUG
+public:
+#else
+protected:
+#endif
+  MGR            &m_mgr;                // Manager to work with
+  byte            m_intindex;           // Interface index
+  byte            m_ccwmask;            // Bits for counterclockwise
+  byte            m_cwmask;             // Bits for clockwise
+  byte            m_inmask;             // Bit of the impulse switch
+  bool            m_bothedges;          // True=count on and off edges
+  unsigned        m_stallticks;         // Refreshes without edge=stalled
+
+  // Motion
+  //
+  // These are changed by the tick handler, which may run in an interrupt
+  // handler; the application only changes them with interrupts disabled.
+  volatile long   m_position;           // Current position (edges)
+  volatile long   m_target;             // Target position (edges)
+  volatile State  m_state;              // Current state
+  signed char     m_dir;                // Direction of motion, 1 or -1
+  byte            m_previn;             // Switch state at previous refresh
+  byte            m_retries;            // Corrections left for this move
+  unsigned        m_ticks;              // Refreshes since last edge
+  unsigned        m_interval;           // Refreshes between last 2 edges
+  unsigned        m_stopinterval;       // Interval when motor switched off
+  long            m_stopposition;       // Position when motor switched off
+  unsigned long   m_coast;              // Learned coast (edges*refreshes)
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  //
+  // Note: the counter-clockwise pin is usually the lower pin (even pin
+  // numbers in our numbering scheme) and the clockwise pin is usually one
+  // pin higher, see FishduinoMotorT.
+  FishduinoServoAxisT(
+    MGR &mgr,                           // Manager to work with
+    byte intindex,                      // Interface index
+    byte ccwpin,                        // Pin to set for counter-clockwise
+    byte inpin,                         // Input pin of the impulse switch
+    bool bothedges = true)              // False=count only on edges
+    : m_mgr(mgr)
+    , m_intindex(intindex)
+    , m_ccwmask(1 << ccwpin)
+    , m_cwmask(1 << (ccwpin + 1))
+    , m_inmask(1 << inpin)
+    , m_bothedges(bothedges)
+    , m_stallticks(DefaultStallTicks)
+    , m_position(0)
+    , m_target(0)
+    , m_state(Idle)
+    , m_dir(1)
+    , m_previn(0)
+    , m_retries(0)
+    , m_ticks(0)
+    , m_interval(0)
+    , m_stopinterval(0)
+    , m_stopposition(0)
+    , m_coast(0)
+  {
+    // Nothing to do here
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Tick handler for the manager
+  static void
+  Handle(
+    void *context)                      // Axis object
+  {
+    ((FishduinoServoAxisT *)context)->Tick();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Start controlling the motor
+  //
+  // The motor outputs are controlled by the axis until End is called; the
+  // other output functions of the manager don't change them.
+  bool                                  // Returns false if too many handlers
+  Begin()
+  {
+    noInterrupts();
+    m_previn = m_mgr.GetTickInputs(m_intindex) & m_inmask;
+    m_mgr.SetTickOutputs(m_intindex, 0, m_ccwmask | m_cwmask);
+    m_state = Idle;
+    interrupts();
+
+    return m_mgr.AddTickHandler(&Handle, this);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Stop controlling the motor
+  //
+  // The motor outputs go back to the state that was set with the other
+  // output functions of the manager.
+  void
+  End()
+  {
+    m_mgr.RemoveTickHandler(&Handle, this);
+
+    noInterrupts();
+    m_mgr.SetTickOutputs(m_intindex, 0, m_ccwmask | m_cwmask);
+    m_state = Idle;
+    interrupts();
+
+    m_mgr.ReleaseTickOutputs(m_intindex, m_ccwmask | m_cwmask);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the time after which a motor that doesn't move is switched off
+  void
+  SetStallTimeout(
+    unsigned ticks)                     // Refreshes without an edge
+  {
+    noInterrupts();
+    m_stallticks = ticks;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Move to a position
+  //
+  // This returns immediately; use IsMoving to find out when the axis has
+  // arrived. If the motor is running in the other direction, it's reversed
+  // right away.
+  void
+  MoveTo(
+    long position)                      // Target position (edges)
+  {
+    noInterrupts();
+    m_target = position;
+    m_retries = MaxRetries;
+
+    if (m_state == Moving)
+    {
+      // Keep the speed measurement if the direction stays the same
+      if ((position - m_position) * m_dir <= 0)
+      {
+        Start();
+      }
+    }
+    else
+    {
+      Start();
+    }
+
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Switch the motor off
+  //
+  // The position keeps counting while the motor coasts to a stop, but the
+  // axis doesn't try to get to the target anymore.
+  void
+  Stop()
+  {
+    noInterrupts();
+
+    if (m_state == Moving)
+    {
+      SwitchOff();
+    }
+
+    m_retries = 0;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Change the current position without moving the motor
+  //
+  // Use this to set the zero point, e.g. after running into a limit
+  // switch. The motor is switched off.
+  void
+  SetPosition(
+    long position)                      // New current position (edges)
+  {
+    noInterrupts();
+    m_mgr.SetTickOutputs(m_intindex, 0, m_ccwmask | m_cwmask);
+    m_position = position;
+    m_target = position;
+    m_state = Idle;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the current position
+  long                                  // Returns position (edges)
+  GetPosition()
+  {
+    noInterrupts();
+    long result = m_position;
+    interrupts();
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the target position
+  long                                  // Returns position (edges)
+  GetTarget()
+  {
+    noInterrupts();
+    long result = m_target;
+    interrupts();
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the current state
+  State
+  GetState()
+  {
+    return m_state;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the axis is moving
+  //
+  // This is true until the motor has stopped, including the time that it
+  // coasts after it was switched off.
+  bool                                  // Returns true=moving
+  IsMoving()
+  {
+    State state = m_state;
+
+    return (state == Moving) || (state == Settling);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the motor stalled
+  //
+  // The motor is switched off if it runs without producing an edge for
+  // the stall timeout. It stays in this state until the next move.
+  bool                                  // Returns true=stalled
+  IsStalled()
+  {
+    return m_state == Stalled;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Switch the motor on towards the target
+  //
+  // Called from the tick handler or with interrupts disabled.
+  void
+  Start()
+  {
+    long left = m_target - m_position;
+
+    if (!left)
+    {
+      m_mgr.SetTickOutputs(m_intindex, 0, m_ccwmask | m_cwmask);
+      m_state = Idle;
+      return;
+    }
+
+    m_dir = (left > 0) ? 1 : -1;
+    m_ticks = 0;
+    m_interval = 0;
+
+    // Turn the other direction off before turning this direction on
+    byte m = (m_dir > 0) ? m_cwmask : m_ccwmask;
+
+    m_mgr.SetTickOutputs(m_intindex, m, (m_ccwmask | m_cwmask) ^ m);
+    m_state = Moving;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Switch the motor off and wait for it to stop
+  //
+  // Called from the tick handler or with interrupts disabled.
+  void
+  SwitchOff()
+  {
+    m_mgr.SetTickOutputs(m_intindex, 0, m_ccwmask | m_cwmask);
+
+    m_stopinterval = m_interval;
+    m_stopposition = m_position;
+    m_ticks = 0;
+    m_state = Settling;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Get the number of edges that the motor will coast at the current speed
+  //
+  // The coast distance is assumed to be proportional to the speed, i.e.
+  // inversely proportional to the time between edges.
+  unsigned long                         // Returns number of edges
+  Lead()
+  {
+    if (!m_interval)
+    {
+      return 0;
+    }
+
+    unsigned long scaled = (unsigned long)m_interval * CoastScale;
+
+    return (m_coast + scaled / 2) / scaled;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Learn the coast distance after the motor stopped
+  //
+  // The new measurement is averaged with the old value, so one disturbed
+  // move doesn't throw the estimate off. The first measurement is used as
+  // it is.
+  void
+  Learn()
+  {
+    if (!m_stopinterval)
+    {
+      return;
+    }
+
+    long overrun = (m_position - m_stopposition) * m_dir;
+
+    if (overrun < 0)
+    {
+      overrun = 0;
+    }
+
+    unsigned long coast = (unsigned long)overrun * m_stopinterval * CoastScale;
+
+    m_coast = m_coast ? (m_coast + coast) / 2 : coast;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Count the edges and control the motor; called by the manager at every
+  // refresh
+  void
+  Tick()
+  {
+    byte in = m_mgr.GetTickInputs(m_intindex) & m_inmask;
+    bool edge = (in != m_previn) && ((m_bothedges) || (in));
+
+    m_previn = in;
+
+    if (m_ticks != (unsigned)~0)
+    {
+      m_ticks++;
+    }
+
+    if (edge)
+    {
+      // While coasting, the motor still turns in the last direction
+      if (m_state != Idle)
+      {
+        m_position += m_dir;
+      }
+
+      m_interval = m_ticks;
+      m_ticks = 0;
+    }
+
+    switch (m_state)
+    {
+    case Moving:
+      {
+        long left = (m_target - m_position) * m_dir;
+
+        if ((left <= 0) || ((edge) && ((unsigned long)left <= Lead())))
+        {
+          SwitchOff();
+        }
+        else if (m_ticks >= m_stallticks)
+        {
+          m_mgr.SetTickOutputs(m_intindex, 0, m_ccwmask | m_cwmask);
+          m_state = Stalled;
+        }
+      }
+      break;
+
+    case Settling:
+      {
+        // The motor has stopped when there was no edge for a few times
+        // the last interval. This is calculated as unsigned long, and
+        // limited to the range of m_ticks, so it can't wrap around.
+        unsigned long settle = (unsigned long)m_stopinterval * 4;
+
+        if (settle < MinSettleTicks)
+        {
+          settle = MinSettleTicks;
+        }
+        else if (settle > (unsigned)~0)
+        {
+          settle = (unsigned)~0;
+        }
+
+        if (m_ticks >= settle)
+        {
+          Learn();
+
+          if ((m_position != m_target) && (m_retries))
+          {
+            m_retries--;
+            Start();
+          }
+          else
+          {
+            m_state = Idle;
+          }
+        }
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+};
+
+
+// Servo axis on an interface of the compatible manager. For other
+// managers, use FishduinoServoAxisT<> with the type of the manager, see
+// FishduinoMgr.h.
+typedef FishduinoServoAxisT<> FishduinoServoAxis;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
@@ -0,0 +1,614 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  This module represents a stepper motor on a FischerTechnik interface.
+
+  A bipolar stepper motor has two coils, which are connected to two motor
+  outputs of the same interface, e.g. M1 and M2. The coils are switched on
+  in one direction or the other, following a full-step or half-step
+  pattern. The steps are generated at every refresh of the manager (see
+  FishduinoMgrN::AddTickHandler), with acceleration and deceleration, so
+  the step rate doesn't depend on how often the main program runs. This
+  works best if the interface is refreshed by a timer:
+
+    #include <FishduinoTimer.h>
+    #include <FishduinoStepper.h>
+
+    FishduinoMgr fishduino;
+    FishduinoStepper stepper(fishduino, 0, FishduinoStepper::M1,
+      FishduinoStepper::M2, true, 1000);
+
+    void setup()
+    {
+      FishduinoTimer::Begin(fishduino, 1000);
+      stepper.SetSpeed(200);            // Steps per second
+      stepper.SetAcceleration(400);     // Steps per second per second
+      stepper.Begin();
+      stepper.MoveTo(1000);
+    }
+
+  The highest step rate is one step per refresh. If you call the update
+  functions of the manager yourself, the steps are made at the tick rate
+  of the manager (see FishduinoMgrN::SetTickRate, 1000 by default), no
+  matter how often Update or UpdateOutputs is called.
+
+  IMPORTANT: These store a reference to a Fishduino manager, but there is no
+  code to guard against orphaning this reference. Make sure you don't call
+  any of the member functions after the manager is destroyed, and call End
+  before a stepper object is destroyed!
+*/
+
+
+#ifndef _FISHDUINOSTEPPER_H_
+#define _FISHDUINOSTEPPER_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// STEPPER MOTOR
+/////////////////////////////////////////////////////////////////////////////
+
+
+template <class MGR = FishduinoMgr>
+class FishduinoStepperT
+{
+public:
+  //-------------------------------------------------------------------------
+  // Constants for better readability
+  //
+  // Use these to select the motor outputs that the coils are connected to;
+  // the same as for FishduinoMotorT.
+  enum {
+    M1 = 0,
+    M2 = 2,
+    M3 = 4,
+    M4 = 6
+  };
+
+  // Speeds are stored as fixed point numbers of steps per refresh
+  enum {
+    FracBits = 24,                      // Number of bits after the point
+  };
+
+#ifndef NDEBUG
+public:
+#else
+protected:
+#endif
+  MGR            &m_mgr;                // Manager to work with
+  byte            m_intindex;           // Interface index
+  byte            m_pinmask[4];         // A+, A-, B+, B- output bits
+  byte            m_allmask;            // All output bits of the coils
+  bool            m_halfstep;           // True=half steps, false=full
+  unsigned        m_hz;                 // Refreshes per second
+
+  // Motion
+  //
+  // These are changed by the tick handler, which may run in an interrupt
+  // handler; the application only changes them with interrupts disabled.
+  volatile long   m_position;           // Current position (steps)
+  volatile long   m_target;             // Target position (steps)
+  uint32_t        m_rate;               // Current speed (steps/refresh)
+  uint32_t        m_maxrate;            // Maximum speed (steps/refresh)
+  uint32_t        m_accel;              // Acceleration (steps/refresh^2)
+  uint32_t        m_minrate;            // Start/stop speed (steps/refresh)
+  uint32_t        m_phase;              // Fraction of the next step
+  unsigned long   m_rampsteps;          // Steps taken while speeding up
+  signed char     m_dir;                // Direction of motion, 1 or -1
+  volatile bool   m_release;            // True=switch coils off when idle
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  //
+  // The coils are connected to two motor outputs; if the motor turns the
+  // wrong way, swap the wires of one coil. The number of refreshes per
+  // second is used to convert speeds and accelerations; it should be the
+  // same as the rate that's passed to FishduinoTimer::Begin, or to the
+  // SetTickRate function of the manager if there's no timer.
+  FishduinoStepperT(
+    MGR &mgr,                           // Manager to work with
+    byte intindex,                      // Interface index
+    byte coila = M1,                    // Motor output for coil A
+    byte coilb = M2,                    // Motor output for coil B
+    bool halfstep = true,               // True=half steps, false=full
+    unsigned hz = 1000)                 // Refreshes per second
+    : m_mgr(mgr)
+    , m_intindex(intindex)
+    , m_halfstep(halfstep)
+    , m_hz(hz ? hz : 1)
+    , m_position(0)
+    , m_target(0)
+    , m_rate(0)
+    , m_phase(0)
+    , m_rampsteps(0)
+    , m_dir(1)
+    , m_release(false)
+  {
+    m_pinmask[0] = 1 << (coila + 1);
+    m_pinmask[1] = 1 << coila;
+    m_pinmask[2] = 1 << (coilb + 1);
+    m_pinmask[3] = 1 << coilb;
+    m_allmask = m_pinmask[0] | m_pinmask[1] | m_pinmask[2] | m_pinmask[3];
+
+    SetSpeed(100);
+    SetAcceleration(0);
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Tick handler for the manager
+  static void
+  Handle(
+    void *context)                      // Stepper object
+  {
+    ((FishduinoStepperT *)context)->Tick();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Start controlling the motor
+  //
+  // This switches the coils on for the current position. The coil outputs
+  // are controlled by the stepper until End is called; the other output
+  // functions of the manager don't change them.
+  bool                                  // Returns false if too many handlers
+  Begin()
+  {
+    noInterrupts();
+    SetCoils();
+    interrupts();
+
+    return m_mgr.AddTickHandler(&Handle, this);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Stop controlling the motor
+  //
+  // The motor stops immediately, and the coil outputs go back to the state
+  // that was set with the other output functions of the manager.
+  void
+  End()
+  {
+    m_mgr.RemoveTickHandler(&Handle, this);
+    m_mgr.ReleaseTickOutputs(m_intindex, m_allmask);
+
+    Halt();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the maximum speed
+  //
+  // The speed can be changed while the motor is moving; it changes
+  // gradually, using the acceleration. The highest possible speed is one
+  // step per refresh.
+  void
+  SetSpeed(
+    unsigned long steps)                // Steps per second
+  {
+    steps = constrain(steps, 1, m_hz);
+
+    // Steps per refresh, scaled to fixed point in two parts to avoid
+    // overflow
+    uint32_t rate = ((steps << 16) / m_hz) << (FracBits - 16);
+
+    noInterrupts();
+    m_maxrate = rate ? rate : 1;
+    interrupts();
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Integer square root
+  static uint32_t                       // Returns square root, rounded down
+  Sqrt(
+    uint32_t x)                         // Number to get the square root of
+  {
+    uint32_t result = 0;
+    uint32_t b = 1UL << 30;
+
+    while (b > x)
+    {
+      b >>= 2;
+    }
+
+    while (b)
+    {
+      if (x >= result + b)
+      {
+        x -= result + b;
+        result = (result >> 1) + b;
+      }
+      else
+      {
+        result >>= 1;
+      }
+
+      b >>= 2;
+    }
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the acceleration
+  //
+  // The motor speeds up and slows down with this acceleration, and the
+  // deceleration starts in time to stop at the target. If it's 0, the
+  // motor starts and stops at full speed, which may make it skip steps.
+  //
+  // The motor never goes slower than the speed that it reaches in one step
+  // from standstill, the square root of twice the acceleration; it can
+  // stop from that speed right away.
+  void
+  SetAcceleration(
+    unsigned long steps)                // Steps per second per second
+  {
+    uint32_t accel = 1UL << FracBits;
+
+    if (steps)
+    {
+      // Steps per refresh per refresh, scaled to fixed point in two parts
+      uint32_t a = (min(steps, 0xFFFFFFUL) << 8) / m_hz;
+
+      if (a < 0x10000UL)
+      {
+        accel = (a << (FracBits - 8)) / m_hz;
+      }
+    }
+
+    if (!accel)
+    {
+      accel = 1;
+    }
+
+    // The result of Sqrt has half the fraction bits
+    uint32_t minrate = Sqrt(accel * 2) << (FracBits / 2);
+
+    noInterrupts();
+    m_accel = accel;
+    m_minrate = minrate;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Move to an absolute position
+  //
+  // This returns immediately; the motor is moved in the background. If the
+  // motor is moving in the other direction, it slows down and stops first.
+  void
+  MoveTo(
+    long position)                      // Target position (steps)
+  {
+    noInterrupts();
+    m_target = position;
+    m_release = false;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Move a number of steps from the current position
+  void
+  Move(
+    long steps)                         // Steps, negative=backwards
+  {
+    noInterrupts();
+    m_target = m_position + steps;
+    m_release = false;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Slow down and stop as soon as possible
+  //
+  // The motor decelerates, so it stops a few steps further than the
+  // current position; GetTarget tells where.
+  void
+  Stop()
+  {
+    noInterrupts();
+
+    if (m_rate)
+    {
+      m_target = m_position + (long)m_rampsteps * m_dir;
+    }
+    else
+    {
+      m_target = m_position;
+    }
+
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Stop immediately
+  //
+  // At high speed, the motor may go on for a few steps by itself, so the
+  // position may be off after this.
+  void
+  Halt()
+  {
+    noInterrupts();
+    m_target = m_position;
+    m_rate = 0;
+    m_phase = 0;
+    m_rampsteps = 0;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Change the current position without moving the motor
+  //
+  // Use this to set the zero point, e.g. after running into a limit
+  // switch. The motor stops immediately.
+  void
+  SetPosition(
+    long position)                      // New current position (steps)
+  {
+    noInterrupts();
+    m_position = position;
+    m_target = position;
+    m_rate = 0;
+    m_phase = 0;
+    m_rampsteps = 0;
+    interrupts();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Switch the coils off until the next move
+  //
+  // A stepper motor uses power while it stands still, to hold its
+  // position. If that's not needed, call this; the coils are switched off
+  // when the motor stops, and on again when it starts moving.
+  void
+  Release()
+  {
+    m_release = true;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the current position
+  long                                  // Returns position (steps)
+  GetPosition()
+  {
+    noInterrupts();
+    long result = m_position;
+    interrupts();
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the target position
+  long                                  // Returns position (steps)
+  GetTarget()
+  {
+    noInterrupts();
+    long result = m_target;
+    interrupts();
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the current speed
+  unsigned long                         // Returns steps per second
+  GetSpeed()
+  {
+    noInterrupts();
+    uint32_t rate = m_rate;
+    interrupts();
+
+    return ((rate >> 8) * m_hz) >> (FracBits - 8);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the motor is moving
+  bool                                  // Returns true=moving
+  IsMoving()
+  {
+    noInterrupts();
+    bool result = (m_rate != 0) || (m_position != m_target);
+    interrupts();
+
+    return result;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Switch the coils on for the current position
+  //
+  // The half-step pattern switches one coil and two coils on, in turns;
+  // the full-step pattern uses only the steps with two coils on, which
+  // gives more torque.
+  void
+  SetCoils()
+  {
+    // Bit 0..3: A+, A-, B+, B-
+    static const byte phases[8] PROGMEM =
+    {
+      0x1, 0x5, 0x4, 0x6, 0x2, 0xA, 0x8, 0x9
+    };
+
+    byte index = (byte)m_position;
+
+    if (!m_halfstep)
+    {
+      index = index * 2 + 1;
+    }
+
+    byte bits = pgm_read_byte(&phases[index & 7]);
+    byte set = 0;
+
+    for (byte k = 0; k < 4; k++)
+    {
+      if (bits & (1 << k))
+      {
+        set |= m_pinmask[k];
+      }
+    }
+
+    m_mgr.SetTickOutputs(m_intindex, set, m_allmask & ~set);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Generate the steps; called by the manager at every refresh
+  //
+  // The speed goes up by the acceleration at every refresh until it
+  // reaches the maximum, and the number of steps that were taken while
+  // speeding up is counted. When the number of steps left to the target is
+  // down to that count, the motor slows down at the same rate, so it
+  // reaches the target just when it's back at the lowest speed.
+  void
+  Tick()
+  {
+    long left = m_target - m_position;
+
+    if (!m_rate)
+    {
+      if (!left)
+      {
+        if (m_release)
+        {
+          m_mgr.SetTickOutputs(m_intindex, 0, m_allmask);
+          m_release = false;
+        }
+
+        return;
+      }
+
+      m_dir = (left > 0) ? 1 : -1;
+    }
+
+    // Steps left in the current direction; 0 means stop (and turn around)
+    unsigned long togo = 0;
+
+    if ((left > 0) && (m_dir > 0))
+    {
+      togo = left;
+    }
+    else if ((left < 0) && (m_dir < 0))
+    {
+      togo = -left;
+    }
+
+    signed char ramp = 0;
+
+    if (togo <= m_rampsteps)
+    {
+      if (m_rate > m_minrate)
+      {
+        m_rate = (m_rate - m_minrate > m_accel) ? m_rate - m_accel : m_minrate;
+        ramp = -1;
+      }
+      else if (!togo)
+      {
+        m_rate = 0;
+        m_phase = 0;
+        m_rampsteps = 0;
+        return;
+      }
+    }
+    else if (m_rate < m_maxrate)
+    {
+      m_rate = min(m_rate + m_accel, m_maxrate);
+      ramp = 1;
+    }
+    else if (m_rate > m_maxrate)
+    {
+      // The maximum speed was lowered while moving
+      m_rate = (m_rate - m_maxrate > m_accel) ? m_rate - m_accel : m_maxrate;
+      ramp = -1;
+    }
+
+    m_phase += m_rate;
+
+    if (m_phase >= (1UL << FracBits))
+    {
+      m_phase -= (1UL << FracBits);
+      m_position += m_dir;
+
+      if (ramp > 0)
+      {
+        m_rampsteps++;
+      }
+      else if ((ramp < 0) && (m_rampsteps))
+      {
+        m_rampsteps--;
+      }
+
+      SetCoils();
+
+      if (m_position == m_target)
+      {
+        m_rate = 0;
+        m_phase = 0;
+        m_rampsteps = 0;
+      }
+    }
+  }
+};
+
+
+// Stepper motor on an interface of the compatible manager. For other
+// managers, use FishduinoStepperT<> with the type of the manager, see
+// FishduinoMgr.h.
+typedef FishduinoStepperT<> FishduinoStepper;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
@@ -0,0 +1,243 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  This module refreshes a Fishduino manager in the background, from the
+  Timer2 compare-match interrupt.
+
+  Usage:
+
+    #include <FishduinoTimer.h>
+
+    FishduinoMgr fishduino;
+
+    void setup()
+    {
+      FishduinoTimer::Begin(fishduino, 1000); // Refresh 1000 times/second
+    }
+
+  After this, the outputs are sent to the interface and the inputs are read
+  at the given rate, no matter what the main program is doing, so there's
+  no danger of running into the output timeout of the interface. The main
+  program uses the manager (and the pin and motor objects) the same way as
+  before; the update functions just don't access the interface anymore.
+  See FishduinoMgr::Tick for more information.
+
+  IMPORTANT: This file defines the interrupt handler, so it must be included
+  in only one source file (usually your sketch). Timer2 is also used by the
+  tone() function, and by PWM on pins 3 and 11 of an Uno; those can't be
+  used together with this module.
+
+  The rate can be between about 62 and a few thousand refreshes per second.
+  The upper limit depends on the number of interfaces and on whether SPI is
+  used: each refresh must be done before the next interrupt happens, and the
+  main program needs some time too.
+*/
+
+
+#ifndef _FISHDUINOTIMER_H_
+#define _FISHDUINOTIMER_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// FISHDUINO TIMER
+/////////////////////////////////////////////////////////////////////////////
+
+
+class FishduinoTimer
+{
+protected:
+  // Function that refreshes the manager (tick=true) or takes it out of
+  // background mode (tick=false). Begin stores a function for the type of
+  // manager that's passed to it, so that all manager types can be used.
+  typedef void (*Handler)(void *mgr, bool tick);
+
+protected:
+  //-------------------------------------------------------------------------
+  // Manager that's refreshed by the interrupt handler
+  static void *volatile &
+  Mgr()
+  {
+    static void *volatile mgr;
+
+    return mgr;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Handler for the manager that's refreshed by the interrupt handler
+  static volatile Handler &
+  Func()
+  {
+    static volatile Handler func;
+
+    return func;
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Handler for a given type of manager
+  template <class MGR>
+  static void
+  Handle(
+    void *mgr,                          // Manager to work with
+    bool tick)                          // True=refresh, false=stop
+  {
+    if (tick)
+    {
+      ((MGR *)mgr)->Tick();
+    }
+    else
+    {
+      ((MGR *)mgr)->SetBackground(false);
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Start refreshing the given manager in the background
+  //
+  // Only one manager can be refreshed at a time; if this is called while
+  // another manager is being refreshed, the other one is stopped first.
+  // Any type of manager can be used (FishduinoMgr or FishduinoMgrN<>).
+  template <class MGR>
+  static bool                           // Returns false if rate impossible
+  Begin(
+    MGR &mgr,                           // Manager to refresh
+    unsigned long hz = 1000)            // Number of refreshes per second
+  {
+    bool result = false;
+
+    End();
+
+#ifdef __AVR__
+    // Prescaler values for Timer2, indexed by clock select value - 1
+    static const unsigned prescalers[] = { 1, 8, 32, 64, 128, 256, 1024 };
+
+    for (byte cs = 1; (hz) && (cs <= sizeof(prescalers) / sizeof(prescalers[0])); cs++)
+    {
+      unsigned long count = F_CPU / prescalers[cs - 1] / hz;
+
+      if ((count > 0) && (count <= 256))
+      {
+        mgr.SetBackground(true);
+
+        noInterrupts();
+
+        Mgr() = &mgr;
+        Func() = &Handle<MGR>;
+
+        // CTC mode, count to OCR2A, interrupt on compare match
+        TCCR2A = _BV(WGM21);
+        TCCR2B = cs;
+        TCNT2  = 0;
+        OCR2A  = (byte)(count - 1);
+        TIMSK2 |= _BV(OCIE2A);
+
+        interrupts();
+
+        result = true;
+        break;
+      }
+    }
+#else
+    (void)mgr;
+    (void)hz;
+#endif
+
+    return result;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Stop refreshing in the background
+  //
+  // After this, the manager goes back to accessing the interface from the
+  // update functions.
+  static void
+  End()
+  {
+    void *mgr = Mgr();
+
+#ifdef __AVR__
+    TIMSK2 &= ~_BV(OCIE2A);
+#endif
+
+    if (mgr)
+    {
+      Mgr() = NULL;
+      Func()(mgr, false);
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Refresh the manager; called by the interrupt handler
+  static void
+  Service()
+  {
+    void *mgr = Mgr();
+
+    if (mgr)
+    {
+      Func()(mgr, true);
+    }
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INTERRUPT HANDLER
+/////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef __AVR__
+ISR(TIMER2_COMPA_vect)
+{
+  FishduinoTimer::Service();
+}
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
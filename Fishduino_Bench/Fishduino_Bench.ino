@@ -0,0 +1,334 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  This sketch measures how long the library's refresh functions take on
+  the Arduino, for 1 to 4 interfaces, and prints a table on the serial
+  port (115200 baud):
+
+  - Cycles: CPU cycles per call, measured with Timer1
+  - us: microseconds per call
+  - Calls/s: the number of calls per second that this allows
+
+  The interface(s) should be connected to pins 2-8 and powered. Timer1
+  counts at the CPU clock frequency, and an overflow interrupt extends it
+  to 32 bits. The time of an empty call is subtracted, so the numbers are
+  for the library function itself. Timer0 keeps running (millis and micros
+  need it), so some calls take a few cycles longer because of its
+  interrupt; the average over a number of calls evens this out.
+
+  To see how many clock pulses and pin operations each function uses,
+  run SimBench in the extras/bench directory; it calls the same functions
+  in the host-side simulation (see extras/sim).
+
+  Send any character to run the benchmark again.
+*/
+
+
+#include <Fishduino.h>
+#include <FishduinoFast.h>
+#include <FishduinoMgr.h>
+
+
+// Number of calls per measurement
+const unsigned long Iterations = 100;
+
+// Objects under test
+Fishduino *ft;
+FishduinoFast<> *fast;
+FishduinoMgr *mgr;
+FishduinoMgr *fastmgr;
+byte num;
+byte outvalues[Fishduino::MaxInterfaces];
+byte invalues[Fishduino::MaxInterfaces];
+
+
+//---------------------------------------------------------------------------
+// Timer
+
+#ifdef __AVR__
+volatile unsigned timer_overflows;
+
+ISR(TIMER1_OVF_vect)
+{
+  timer_overflows++;
+}
+
+void timer_start()
+{
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = 0;
+  TCNT1 = 0;
+  timer_overflows = 0;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+  TCCR1B = _BV(CS10);
+  interrupts();
+}
+
+unsigned long timer_stop()
+{
+  noInterrupts();
+  TCCR1B = 0;
+
+  unsigned long result = ((unsigned long)timer_overflows << 16) | TCNT1;
+
+  if (TIFR1 & _BV(TOV1))
+  {
+    result += 0x10000UL;
+  }
+
+  TIMSK1 = 0;
+  TIFR1 = _BV(TOV1);
+  interrupts();
+
+  return result;
+}
+#else
+// Not an AVR: use micros instead
+unsigned long timer_startus;
+
+void timer_start()
+{
+  timer_startus = micros();
+}
+
+unsigned long timer_stop()
+{
+  return (micros() - timer_startus) * (F_CPU / 1000000UL);
+}
+#endif
+
+
+//---------------------------------------------------------------------------
+// Operations to measure
+
+void do_nothing()
+{
+}
+
+void do_setoutputs()
+{
+  outvalues[0]++;
+  ft->SetOutputs(num, outvalues);
+}
+
+void do_getinputs()
+{
+  ft->GetInputs(num, invalues);
+}
+
+void do_exchange()
+{
+  outvalues[0]++;
+  ft->Exchange(num, outvalues, invalues);
+}
+
+void do_fastexchange()
+{
+  outvalues[0]++;
+  fast->Exchange(num, outvalues, invalues);
+}
+
+void do_getanalog()
+{
+  ft->GetAnalog(0);
+}
+
+void do_reset()
+{
+  ft->Reset(num);
+}
+
+void do_update()
+{
+  mgr->SetOutputPin(0, 0, !mgr->GetOutputPin(0, 0));
+  mgr->Update();
+}
+
+void do_fastupdate()
+{
+  fastmgr->SetOutputPin(0, 0, !fastmgr->GetOutputPin(0, 0));
+  fastmgr->Update();
+}
+
+void do_updateoutputs()
+{
+  mgr->SetOutputPin(0, 0, !mgr->GetOutputPin(0, 0));
+  mgr->UpdateOutputs();
+}
+
+void do_updateoutputssame()
+{
+  mgr->UpdateOutputs();
+}
+
+void do_updateinputs()
+{
+  mgr->UpdateInputs();
+}
+
+// Table of operations
+struct Operation
+{
+  const char   *name;
+  void        (*func)();
+};
+
+const Operation operations[] =
+{
+  { "SetOutputs",                do_setoutputs },
+  { "GetInputs",                 do_getinputs },
+  { "Exchange",                  do_exchange },
+  { "FishduinoFast::Exchange",   do_fastexchange },
+  { "GetAnalog",                 do_getanalog },
+  { "Reset",                     do_reset },
+  { "Mgr::Update",               do_update },
+  { "Mgr::Update (fast pins)",   do_fastupdate },
+  { "Mgr::UpdateOutputs",        do_updateoutputs },
+  { "Mgr::UpdateOutputs (same)", do_updateoutputssame },
+  { "Mgr::UpdateInputs",         do_updateinputs },
+};
+
+
+//---------------------------------------------------------------------------
+// Measure the average number of cycles of an operation
+
+unsigned long measure(void (*func)())
+{
+  // Call once first, so one-time costs aren't counted
+  func();
+
+  timer_start();
+
+  for (unsigned long u = 0; u < Iterations; u++)
+  {
+    func();
+  }
+
+  return timer_stop() / Iterations;
+}
+
+
+//---------------------------------------------------------------------------
+// Print a value right-aligned in a column
+
+void print_column(unsigned long value, byte width)
+{
+  unsigned long v = value;
+  byte digits = 1;
+
+  while (v >= 10)
+  {
+    v /= 10;
+    digits++;
+  }
+
+  while (digits++ < width)
+  {
+    Serial.print(' ');
+  }
+
+  Serial.print(value);
+}
+
+
+//---------------------------------------------------------------------------
+// Run the benchmark
+
+void run()
+{
+  Serial.println(F("Operation                  N    Cycles       us  Calls/s"));
+
+  for (unsigned op = 0; op < sizeof(operations) / sizeof(operations[0]); op++)
+  {
+    for (num = 1; num <= Fishduino::MaxInterfaces; num++)
+    {
+      Fishduino f(2, num);
+      FishduinoFast<> ff(num);
+      FishduinoMgr m(2, num);
+      FishduinoMgr fm(2, num);
+
+      FishduinoFast<>::Attach(fm);
+
+      ft = &f;
+      fast = &ff;
+      mgr = &m;
+      fastmgr = &fm;
+
+      unsigned long overhead = measure(do_nothing);
+      unsigned long cycles = measure(operations[op].func);
+
+      cycles = (cycles > overhead) ? cycles - overhead : 0;
+
+      unsigned long us = cycles / (F_CPU / 1000000UL);
+
+      Serial.print(operations[op].name);
+      for (byte u = strlen(operations[op].name); u < 25; u++)
+      {
+        Serial.print(' ');
+      }
+      print_column(num, 3);
+      print_column(cycles, 10);
+      print_column(us, 9);
+      print_column(cycles ? F_CPU / cycles : 0, 9);
+      Serial.println();
+    }
+  }
+
+  Serial.println();
+}
+
+
+//---------------------------------------------------------------------------
+// Standard Arduino functions
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial.println(F("Fishduino benchmark"));
+
+  run();
+}
+
+void loop()
+{
+  if (Serial.available())
+  {
+    while (Serial.available())
+    {
+      Serial.read();
+    }
+
+    run();
+  }
+}
@@ -748,16 +748,10 @@ void loop()
       }
     }
 
-    static unsigned long lastoutputupdatetime;
-    unsigned long ul = millis();
-
-    // If an event was set or if it's been a while since the outputs were
-    // updated, do it now.
-    if ((event != EventNone) || (ul - lastoutputupdatetime > 5000))
-    {
-      lastoutputupdatetime = ul;
-      fishduino.UpdateOutputs();
-    }
+    // Update the outputs. This only shifts the outputs to the interface
+    // if they changed, or if it's necessary to keep the interface from
+    // turning the outputs off.
+    fishduino.UpdateOutputs();
 
     // If the state was changed by the last event handler, flag it
     if (new_state != cur_state)
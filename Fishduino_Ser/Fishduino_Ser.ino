@@ -46,6 +46,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   Windows (even a different version) and install RoboPro. Then you can set
   up a COM port in that virtual machine that redirects to a USB serial port
   on the host. I tested this with VBox and it works.
+
+  Programs that know about this sketch can switch to an extended protocol
+  after the first legacy command. The extended protocol runs at a higher
+  baud rate, and it uses frames with sequence numbers and a CRC, so the
+  host can send several frames without waiting for the replies, and
+  corrupted frames are rejected instead of being sent to the motors. See
+  the "fishduino_protocol.txt" file.
 */
 
 
@@ -56,14 +63,59 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <Fishduino.h>
 
+#ifdef __AVR__
+#include <util/crc16.h>
+#endif
+
 
 /////////////////////////////////////////////////////////////////////////////
 // TYPES
 /////////////////////////////////////////////////////////////////////////////
 
 
-// Type definition for state machine function
-typedef void statefunc_t(byte c);
+// Receive buffer
+//
+// Everything that the serial port received is moved to the buffer, and
+// is only used when a whole command or frame is there. If the rest of a
+// command doesn't arrive in time, a byte was lost, and the partial command
+// is thrown away; otherwise the next command byte would be taken as the
+// missing motor byte.
+enum
+{
+  RxBufferSize = 64,                    // Size of receive buffer
+  RxGapTimeout = 20,                    // ms before partial command dropped
+};
+
+// Extended protocol, see fishduino_protocol.txt
+enum
+{
+  ExtRequest = 0xE1,                    // Legacy command to switch to ext.
+  ExtSync = 0xA5,                       // First byte of each frame
+  ExtHeaderSize = 4,                    // Sync, sequence, command, length
+  ExtCrcSize = 2,                       // CRC-16, big-endian
+  ExtMaxPayload = 8,                    // Max payload length
+  ExtFrameSize = ExtHeaderSize + ExtMaxPayload + ExtCrcSize,
+  ExtTimeout = 2000,                    // ms without frames before leaving
+};
+
+// Extended commands
+enum
+{
+  ExtCmdExchange = 0x01,                // Set outputs, get inputs
+  ExtCmdSubscribe = 0x02,               // Start/stop sending input changes
+  ExtCmdInputs = 0x03,                  // Unsolicited: inputs changed
+  ExtCmdLeave = 0x0F,                   // Go back to the legacy protocol
+  ExtCmdNak = 0x7F,                     // Reply: frame rejected
+};
+
+// Error codes in NAK replies
+enum
+{
+  ExtErrCrc = 1,                        // CRC mismatch or bad header
+  ExtErrCommand,                        // Unknown command
+  ExtErrLength,                         // Wrong payload length
+  ExtErrTimeout,                        // Rest of frame didn't arrive
+};
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -72,11 +124,28 @@ typedef void statefunc_t(byte c);
 
 
 Fishduino           ft;                 // Interface object
-statefunc_t        *state = do_command; // Current state function pointer
-unsigned            num_interfaces;     // Number of I/O bytes to expect/send
-unsigned            num_received;       // Number of motor bytes so far
-byte                out_data[4];        // Output bytes received
-byte                want_analog;        // Requested analog input, 255=none
+byte                rx_buf[RxBufferSize]; // Received bytes not used yet
+byte                rx_len;             // Number of bytes in rx_buf
+unsigned long       rx_lastbyte;        // millis() of last received byte
+bool                legacy_done;        // Legacy command completed
+bool                extended;           // Extended protocol in use
+bool                resyncing;          // Looking for frame after error
+unsigned long       ext_lastframe;      // millis() of last valid frame
+byte                ext_outputs[Fishduino::MaxInterfaces]; // Last outputs
+
+// Subscription: the interface is refreshed without commands from the host,
+// and the inputs are sent to the host when they change
+byte                sub_num;            // Number of interfaces, 0=off
+byte                sub_interval;       // Refresh interval (ms)
+unsigned long       sub_last;           // millis() of last refresh
+byte                sub_seq;            // Sequence number of next record
+byte                sub_inputs[Fishduino::MaxInterfaces]; // Inputs sent
+
+// Baud rates for the extended protocol, indexed by the code in the request
+const unsigned long ext_bauds[] =
+{
+  9600, 19200, 38400, 57600, 115200, 250000, 500000, 1000000
+};
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -102,93 +171,401 @@ void setup()
 // Main loop
 void loop()
 {
-  int c = Serial.read();
+  // Move everything that was received to the buffer
+  while ((rx_len < sizeof(rx_buf)) && (Serial.available() > 0))
+  {
+    rx_buf[rx_len++] = Serial.read();
+    rx_lastbyte = millis();
+  }
+
+  // Execute all complete commands or frames in the buffer
+  while (rx_len)
+  {
+    byte used = extended ? parse_frame() : parse_command();
+
+    if (!used)
+    {
+      break;
+    }
+
+    rx_len -= used;
+    memmove(rx_buf, rx_buf + used, rx_len);
+  }
+
+  // If the rest of a command doesn't arrive, throw the partial command away
+  if ((rx_len) && (millis() - rx_lastbyte >= RxGapTimeout))
+  {
+    if ((extended) && (!resyncing) && (rx_len > 1))
+    {
+      send_nak(rx_buf[1], ExtErrTimeout);
+    }
+
+    rx_len = 0;
+    resyncing = false;
+  }
 
-  if (c >= 0)
+  // Refresh the interface for the subscription
+  if ((sub_num) && (millis() - sub_last >= sub_interval))
   {
-    state(c);
+    refresh_subscription();
+  }
+
+  // If the host stops talking in extended mode, go back to the legacy
+  // protocol, so that the next program can connect at 9600 baud.
+  if ((extended) && (millis() - ext_lastframe >= ExtTimeout))
+  {
+    leave_extended();
   }
 }
 
 
 //---------------------------------------------------------------------------
-// State function to interpret a command byte
-void do_command(byte c)
+// Execute the legacy command at the start of the receive buffer
+//
+// Returns the number of bytes used, or 0 if the command isn't complete.
+byte parse_command()
 {
+  byte c = rx_buf[0];
+
   if (c == 0xD2)
   {
     // Old LLWin identification command
     // Just send the character back and wait for the next command
     Serial.write(c);
+    return 1;
   }
-  else if ((c >= 0xC1) && (c < 0xCD))
+
+  if ((c >= 0xC1) && (c < 0xCD))
   {
-    // Calculate number of interfaces
-    num_interfaces = (((unsigned)c - 1) & 3) + 1;
+    // Calculate number of interfaces; there's one motor byte for each
+    byte num_interfaces = ((c - 1) & 3) + 1;
 
-    // Check if an analog input was requested
-    if (c < 0xC5)
+    if (rx_len < 1 + num_interfaces)
     {
-      want_analog = 255;
+      return 0;
     }
-    else if (c < 0xC9)
-    {
-      want_analog = 0;
-    }
-    else
+
+    do_output(c, rx_buf + 1, num_interfaces);
+    return 1 + num_interfaces;
+  }
+
+  if ((c == ExtRequest) && (legacy_done))
+  {
+    // Request to switch to the extended protocol; the baud rate follows
+    if (rx_len < 2)
     {
-      want_analog = 1;
+      return 0;
     }
 
-    // Initialize count of output bytes received
-    num_received = 0;
+    do_negotiate(rx_buf[1]);
+    return 2;
+  }
+
+  // Unknown command; just wait for the next comand
+  return 1;
+}
 
-    // There is always at least one output byte so set the state to the
-    // output byte handler unconditionally
-    state = do_output;
+
+//---------------------------------------------------------------------------
+// Execute a legacy I/O command
+void do_output(byte c, const byte *out_data, byte num_interfaces)
+{
+  byte reply[6];
+  byte num_to_send = num_interfaces;
+  byte want_analog;
+
+  // Check if an analog input was requested
+  if (c < 0xC5)
+  {
+    want_analog = 255;
+  }
+  else if (c < 0xC9)
+  {
+    want_analog = 0;
   }
   else
   {
-    // Unknown command; just wait for the next comand
+    want_analog = 1;
   }
+
+  ft.SetOutputs(num_interfaces, out_data);
+  ft.GetInputs(num_interfaces, reply);
+
+  if (want_analog != 255)
+  {
+    unsigned analog = ft.GetAnalog(want_analog);
+
+    // Store the word value in big-endian order
+#if 0
+    // TODO: scale to 0..1023
+    reply[num_to_send++] = (byte)(analog >> 8);
+    reply[num_to_send++] = (byte)(analog);
+#else
+    reply[num_to_send++] = 0;
+    reply[num_to_send++] = 167;
+#endif
+  }
+
+  // Send the reply
+  Serial.write(reply, num_to_send);
+
+  // The host talks the legacy protocol, so it may switch to extended
+  legacy_done = true;
 }
 
 
 //---------------------------------------------------------------------------
-// State function to interpret motor bytes from the host
-void do_output(byte c)
+// Execute a request to switch to the extended protocol
+void do_negotiate(byte code)
 {
-  // Store the byte
-  out_data[num_received++] = c;
+  byte reply[2];
+
+  // Acknowledge at the old baud rate; the host switches when it gets this
+  reply[0] = ExtRequest;
+  reply[1] = (code < sizeof(ext_bauds) / sizeof(ext_bauds[0])) ? code : 0xFF;
+
+  Serial.write(reply, sizeof(reply));
 
-  // Once we got all motor bytes, send the reply and reset the state
-  if (num_received == num_interfaces)
+  if (reply[1] == 0xFF)
   {
-    byte reply[6];
-    unsigned num_to_send = num_interfaces;
+    return;
+  }
 
-    ft.SetOutputs(num_interfaces, out_data);
-    ft.GetInputs(num_interfaces, reply);
+  Serial.flush();
+  Serial.begin(ext_bauds[code]);
 
-    if (want_analog != 255)
-    {
-      unsigned analog = ft.GetAnalog(want_analog);
+  extended = true;
+  resyncing = false;
+  ext_lastframe = millis();
+}
 
-      // Store the word value in big-endian order
-#if 0
-      // TODO: scale to 0..1023
-      reply[num_to_send++] = (byte)(analog >> 8);
-      reply[num_to_send++] = (byte)(analog);
+
+//---------------------------------------------------------------------------
+// Go back to the legacy protocol
+void leave_extended()
+{
+  // Don't keep the motors running for a host that's not there anymore
+  if (sub_num)
+  {
+    sub_num = 0;
+    memset(ext_outputs, 0, sizeof(ext_outputs));
+    ft.SetOutputs(NULL);
+  }
+
+  Serial.flush();
+  Serial.begin(9600);
+
+  extended = false;
+  legacy_done = false;
+}
+
+
+//---------------------------------------------------------------------------
+// Calculate the CRC of a frame (CRC-16/CCITT-FALSE)
+word crc16(const byte *data, unsigned len)
+{
+  word crc = 0xFFFF;
+
+  while (len--)
+  {
+#ifdef __AVR__
+    crc = _crc_xmodem_update(crc, *data++);
 #else
-      reply[num_to_send++] = 0;
-      reply[num_to_send++] = 167;
+    crc ^= (word)*data++ << 8;
+
+    for (byte u = 0; u < 8; u++)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
 #endif
+  }
+
+  return crc;
+}
+
+
+//---------------------------------------------------------------------------
+// Send an extended frame
+void send_frame(byte seq, byte cmd, const byte *payload, byte len)
+{
+  byte buf[ExtFrameSize];
+
+  buf[0] = ExtSync;
+  buf[1] = seq;
+  buf[2] = cmd;
+  buf[3] = len;
+
+  if (len)
+  {
+    memcpy(buf + ExtHeaderSize, payload, len);
+  }
+
+  word crc = crc16(buf, ExtHeaderSize + len);
+
+  buf[ExtHeaderSize + len] = (byte)(crc >> 8);
+  buf[ExtHeaderSize + len + 1] = (byte)crc;
+
+  Serial.write(buf, ExtHeaderSize + len + ExtCrcSize);
+}
+
+
+//---------------------------------------------------------------------------
+// Send a reply that rejects a frame
+void send_nak(byte seq, byte error)
+{
+  send_frame(seq, ExtCmdNak, &error, 1);
+}
+
+
+//---------------------------------------------------------------------------
+// Check and execute the extended frame at the start of the receive buffer
+//
+// Returns the number of bytes used, or 0 if the frame isn't complete.
+//
+// If the header or CRC is bad, a byte was lost or corrupted, and the
+// length can't be trusted. So only the sync byte is skipped, and the
+// parser looks for the next sync byte; the next frame may have started
+// inside the bad one. Only the first bad frame is answered with a NAK;
+// after that, the data is skipped silently until a good frame comes in,
+// so that sync bytes inside the rest of the bad frame don't cause more
+// replies.
+byte parse_frame()
+{
+  if (rx_buf[0] != ExtSync)
+  {
+    // Skip anything between frames
+    return 1;
+  }
+
+  if (rx_len < ExtHeaderSize)
+  {
+    return 0;
+  }
+
+  byte len = rx_buf[3];
+  byte size = ExtHeaderSize + len + ExtCrcSize;
+
+  if (len <= ExtMaxPayload)
+  {
+    if (rx_len < size)
+    {
+      return 0;
     }
 
-    // Send the reply
-    Serial.write(reply, num_to_send);
+    word crc = ((word)rx_buf[size - 2] << 8) | rx_buf[size - 1];
+
+    if (crc == crc16(rx_buf, size - ExtCrcSize))
+    {
+      resyncing = false;
+      ext_lastframe = millis();
+
+      do_frame(rx_buf[1], rx_buf[2], rx_buf + ExtHeaderSize, len);
+      return size;
+    }
+  }
+
+  if (!resyncing)
+  {
+    send_nak(rx_buf[1], ExtErrCrc);
+    resyncing = true;
+  }
+
+  return 1;
+}
+
+
+//---------------------------------------------------------------------------
+// Execute an extended frame
+void do_frame(byte seq, byte cmd, const byte *payload, byte len)
+{
+  switch (cmd)
+  {
+  case ExtCmdExchange:
+    {
+      // Payload: analog flags (bit 0=EX, bit 1=EY), 1 output byte per
+      // interface. Reply: 1 input byte per interface, then the requested
+      // analog inputs in microseconds, big-endian.
+      if ((len < 2) || (len > 1 + Fishduino::MaxInterfaces))
+      {
+        send_nak(seq, ExtErrLength);
+        break;
+      }
+
+      byte num = len - 1;
+      byte reply[Fishduino::MaxInterfaces + 4];
+      byte num_to_send = num;
+
+      ft.Exchange(num, payload + 1, reply);
+
+      // Remember the outputs for the subscription. The host knows the
+      // inputs now, so they're only sent again if they change.
+      memcpy(ext_outputs, payload + 1, num);
+      memcpy(sub_inputs, reply, min(num, sub_num));
+
+      for (byte u = 0; u < 2; u++)
+      {
+        if (payload[0] & (1 << u))
+        {
+          unsigned analog = ft.GetAnalog(u);
+
+          reply[num_to_send++] = (byte)(analog >> 8);
+          reply[num_to_send++] = (byte)(analog);
+        }
+      }
+
+      send_frame(seq, ExtCmdExchange, reply, num_to_send);
+    }
+    break;
+
+  case ExtCmdSubscribe:
+    // Payload: number of interfaces (0=stop), refresh interval in ms
+    // Reply: 1 input byte per interface
+    if ((len != 2) || (payload[0] > Fishduino::MaxInterfaces))
+    {
+      send_nak(seq, ExtErrLength);
+      break;
+    }
+
+    sub_num = payload[0];
+    sub_interval = payload[1];
+
+    if (sub_num)
+    {
+      ft.Exchange(sub_num, ext_outputs, sub_inputs);
+      sub_last = millis();
+    }
+
+    send_frame(seq, ExtCmdSubscribe, sub_inputs, sub_num);
+    break;
+
+  case ExtCmdLeave:
+    send_frame(seq, ExtCmdLeave, NULL, 0);
+    leave_extended();
+    break;
+
+  default:
+    send_nak(seq, ExtErrCommand);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Refresh the interface for the subscription, and send changed inputs
+//
+// The outputs are sent again at every refresh, so they stay on even if the
+// host only sends frames every now and then.
+void refresh_subscription()
+{
+  byte inputs[Fishduino::MaxInterfaces];
+
+  sub_last = millis();
+
+  ft.Exchange(sub_num, ext_outputs, inputs);
+
+  if (memcmp(inputs, sub_inputs, sub_num))
+  {
+    memcpy(sub_inputs, inputs, sub_num);
 
-    // Get us ready for the next command
-    state = do_command;
+    send_frame(sub_seq++, ExtCmdInputs, inputs, sub_num);
   }
 }
@@ -0,0 +1,272 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  Benchmark of the library's refresh functions in the host-side simulation.
+
+  Every function is called a number of times for 1 to 4 interfaces, and the
+  average cost of one call is printed: simulated CPU cycles and
+  microseconds, calls per second, calls to digitalWrite and digitalRead,
+  and rising edges on the CLOCK line as counted by the simulated interface.
+
+  The cycle counts are based on the rough costs in Sim::Cost, and on the
+  host, the library uses digitalWrite and digitalRead instead of the port
+  registers (FishduinoFast uses the cheaper digitalWriteFast and
+  digitalReadFast), so they don't match an AVR exactly. The number of pin
+  operations and clock edges does match, so this is good for comparing
+  versions of the library. Use the Fishduino_Bench sketch to measure the
+  real timing on an Arduino.
+
+  Usage: SimBench [-c] [iterations]
+
+  -c prints comma-separated values instead of a table. The default number
+  of iterations is 100.
+*/
+
+
+#include <stdio.h>
+
+#include "Sim30520.h"
+#include "FishduinoFast.h"
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+static Fishduino       *s_ft;           // Object under test
+static FishduinoFast<> *s_fast;         // Object under test
+static FishduinoMgr    *s_mgr;          // Object under test
+static FishduinoMgr    *s_fastmgr;      // Object under test, fast pins
+static byte             s_num;          // Number of interfaces
+static byte             s_out[Fishduino::MaxInterfaces];
+static byte             s_in[Fishduino::MaxInterfaces];
+
+
+/////////////////////////////////////////////////////////////////////////////
+// BENCHMARKED OPERATIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+static void SetOutputs()
+{
+  s_out[0]++;
+  s_ft->SetOutputs(s_num, s_out);
+}
+
+
+//---------------------------------------------------------------------------
+static void GetInputs()
+{
+  s_ft->GetInputs(s_num, s_in);
+}
+
+
+//---------------------------------------------------------------------------
+static void Exchange()
+{
+  s_out[0]++;
+  s_ft->Exchange(s_num, s_out, s_in);
+}
+
+
+//---------------------------------------------------------------------------
+static void FastExchange()
+{
+  s_out[0]++;
+  s_fast->Exchange(s_num, s_out, s_in);
+}
+
+
+//---------------------------------------------------------------------------
+static void GetAnalog()
+{
+  s_ft->GetAnalog(0);
+}
+
+
+//---------------------------------------------------------------------------
+static void Reset()
+{
+  s_ft->Reset(s_num);
+}
+
+
+//---------------------------------------------------------------------------
+static void MgrUpdate()
+{
+  s_mgr->SetOutputPin(0, 0, !s_mgr->GetOutputPin(0, 0));
+  s_mgr->Update();
+}
+
+
+//---------------------------------------------------------------------------
+static void FastMgrUpdate()
+{
+  s_fastmgr->SetOutputPin(0, 0, !s_fastmgr->GetOutputPin(0, 0));
+  s_fastmgr->Update();
+}
+
+
+//---------------------------------------------------------------------------
+static void MgrUpdateOutputs()
+{
+  s_mgr->SetOutputPin(0, 0, !s_mgr->GetOutputPin(0, 0));
+  s_mgr->UpdateOutputs();
+}
+
+
+//---------------------------------------------------------------------------
+static void MgrUpdateOutputsSame()
+{
+  s_mgr->UpdateOutputs();
+}
+
+
+//---------------------------------------------------------------------------
+static void MgrUpdateInputs()
+{
+  s_mgr->UpdateInputs();
+}
+
+
+// Table of operations
+static const struct
+{
+  const char   *name;
+  void        (*func)();
+} s_ops[] =
+{
+  { "SetOutputs",               SetOutputs },
+  { "GetInputs",                GetInputs },
+  { "Exchange",                 Exchange },
+  { "FishduinoFast::Exchange",  FastExchange },
+  { "GetAnalog (1000us)",       GetAnalog },
+  { "Reset",                    Reset },
+  { "Mgr::Update",              MgrUpdate },
+  { "Mgr::Update (fast pins)",  FastMgrUpdate },
+  { "Mgr::UpdateOutputs",       MgrUpdateOutputs },
+  { "Mgr::UpdateOutputs (same)",MgrUpdateOutputsSame },
+  { "Mgr::UpdateInputs",        MgrUpdateInputs },
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Main program
+int main(
+  int argc,
+  char *argv[])
+{
+  bool csv = false;
+  unsigned long iterations = 100;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-c"))
+    {
+      csv = true;
+    }
+    else if ((iterations = strtoul(argv[i], NULL, 0)) == 0)
+    {
+      fprintf(stderr, "Usage: %s [-c] [iterations]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  Sim30520 iface(2, Fishduino::MaxInterfaces);
+
+  if (csv)
+  {
+    printf("operation,interfaces,cycles,us,calls_per_s,writes,reads,clocks\n");
+  }
+  else
+  {
+    printf("%-26s %2s %10s %9s %9s %7s %7s %7s\n",
+      "Operation", "N", "Cycles", "us", "Calls/s", "Writes", "Reads", "Clocks");
+  }
+
+  for (unsigned op = 0; op < sizeof(s_ops) / sizeof(s_ops[0]); op++)
+  {
+    for (s_num = 1; s_num <= Fishduino::MaxInterfaces; s_num++)
+    {
+      Fishduino ft(2, s_num);
+      FishduinoFast<> fast(s_num);
+      FishduinoMgr mgr(2, s_num);
+      FishduinoMgr fastmgr(2, s_num);
+
+      FishduinoFast<>::Attach(fastmgr);
+
+      s_ft = &ft;
+      s_fast = &fast;
+      s_mgr = &mgr;
+      s_fastmgr = &fastmgr;
+
+      // Warm up once, so one-time costs aren't counted
+      s_ops[op].func();
+
+      Sim::ResetCounters();
+      iface.ResetCounters();
+      unsigned long long start = Sim::Cycles();
+
+      for (unsigned long u = 0; u < iterations; u++)
+      {
+        s_ops[op].func();
+      }
+
+      double cycles = (double)(Sim::Cycles() - start) / iterations;
+      double us = cycles * 1000000.0 / F_CPU;
+      Sim::Counters core = Sim::GetCounters();
+      Sim30520::Counters hw = iface.GetCounters();
+
+      printf(csv ? "%s,%u,%.0f,%.1f,%.0f,%.1f,%.1f,%.1f\n"
+        : "%-26s %2u %10.0f %9.1f %9.0f %7.1f %7.1f %7.1f\n",
+        s_ops[op].name, s_num, cycles, us, 1000000.0 / us,
+        (double)core.pinwrites / iterations,
+        (double)core.pinreads / iterations,
+        (double)hw.clocks / iterations);
+    }
+  }
+
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
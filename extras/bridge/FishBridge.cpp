@@ -0,0 +1,943 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  Bridge between programs that use the 30402 protocol and one Arduino with
+  the Fishduino_Ser sketch (or a simulation of it), for Linux.
+
+  Normally, only one program at a time can use the serial port of the
+  Arduino. The bridge opens the serial port, and offers the protocol of the
+  30402 "Intelligent Interface" (see Documentation/ft_protocol.txt) to any
+  number of clients, on pseudo terminals and/or a Unix domain socket:
+
+  - Each client sends commands (0xC1..0xCC plus motor bytes) as if it's the
+    only one. The bridge sends the inputs from the interface back to it.
+  - The outputs of all clients are ORed together. The outputs of a client
+    are dropped when it hasn't sent a command for 300ms, the same way the
+    30402 turns its outputs off.
+  - Commands that arrive at the same time are combined into one command to
+    the Arduino (or one per analog input that was requested), so the number
+    of clients doesn't slow things down much.
+
+  The Arduino can be connected to a serial port, or the bridge can start a
+  program that runs the sketch in the simulation (see extras/sim) and talk
+  to it through its stdin and stdout, to try things out without hardware.
+
+  See README.md for how to build and run.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+typedef uint8_t byte;
+
+// Miscellaneous constants
+enum
+{
+  MaxClients = 16,                      // Max number of clients
+  MaxInterfaces = 4,                    // Max interfaces in the protocol
+  MaxReply = MaxInterfaces + 2,         // Max length of a reply
+  ClientTimeout = 300,                  // ms before outputs of client drop
+  GapTimeout = 50,                      // ms before partial command drops
+  BackendTimeout = 500,                 // ms to wait for reply from Arduino
+  DefaultStartupDelay = 2000,           // ms to wait for Arduino to boot
+  PollInterval = 10,                    // ms between checks for timeouts
+};
+
+// Protocol
+enum
+{
+  CmdIdentify = 0xD2,                   // LLWin identification, echoed
+  CmdFirst = 0xC1,                      // First I/O command
+  CmdLast = 0xCC,                       // Last I/O command
+};
+
+// Analog input requested by an I/O command
+enum
+{
+  AnalogNone,
+  AnalogX,
+  AnalogY,
+
+  NumAnalog
+};
+
+
+//---------------------------------------------------------------------------
+// Connection to a client program
+struct Client
+{
+  int               fd;                 // File descriptor, -1=not in use
+  int               slavefd;            // Slave side of pty (kept open)
+  bool              socket;             // True=socket, false=pty
+  char              name[108];          // Name for messages
+  char              link[108];          // Symbolic link to pty, "" if none
+  byte              rx[1 + MaxInterfaces]; // Partial command
+  byte              rxlen;              // Bytes in rx
+  unsigned long     rxtime;             // Time of last byte
+  byte              outputs[MaxInterfaces]; // Outputs of last command
+  byte              num;                // Number of interfaces of last cmd
+  unsigned long     lasttime;           // Time of last command
+  bool              pending;            // True=waiting for reply
+  byte              analog;             // Analog input of pending command
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+static Client           s_clients[MaxClients];
+static int              s_listenfd = -1; // Unix socket to accept clients
+static char             s_socketpath[108]; // Path of Unix socket
+static int              s_backin = -1;  // Read replies from Arduino
+static int              s_backout = -1; // Write commands to Arduino
+static pid_t            s_child = -1;   // Simulation process
+static bool             s_verbose;      // True=log every transaction
+static volatile sig_atomic_t s_quit;    // Set by signal handler
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the time in milliseconds
+static unsigned long Now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (unsigned long)ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+
+//---------------------------------------------------------------------------
+// Print a message to stderr
+static void Log(
+  const char *format,                 // printf format
+  ...)
+{
+  va_list ap;
+
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+
+  fputc('\n', stderr);
+}
+
+
+//---------------------------------------------------------------------------
+// Make a file descriptor non-blocking
+static void SetNonBlocking(
+  int fd)                             // File descriptor
+{
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+
+//---------------------------------------------------------------------------
+// Write a buffer completely, waiting if necessary
+static bool                           // Returns false on error
+WriteAll(
+  int fd,                             // File descriptor
+  const byte *data,                   // Data to write
+  size_t len)                         // Number of bytes
+{
+  while (len)
+  {
+    ssize_t n = write(fd, data, len);
+
+    if (n < 0)
+    {
+      if ((errno == EAGAIN) || (errno == EINTR))
+      {
+        struct pollfd p = { fd, POLLOUT, 0 };
+
+        poll(&p, 1, BackendTimeout);
+        continue;
+      }
+
+      return false;
+    }
+
+    data += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CLIENTS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get an unused client entry
+static Client *                       // Returns NULL if too many clients
+NewClient()
+{
+  for (unsigned u = 0; u < MaxClients; u++)
+  {
+    Client &c = s_clients[u];
+
+    if (c.fd < 0)
+    {
+      memset(&c, 0, sizeof(c));
+      c.fd = -1;
+      c.slavefd = -1;
+
+      return &c;
+    }
+  }
+
+  return NULL;
+}
+
+
+//---------------------------------------------------------------------------
+// Close a client
+static void CloseClient(
+  Client &c)                          // Client to close
+{
+  if (c.fd >= 0)
+  {
+    Log("%s: closed", c.name);
+
+    close(c.fd);
+  }
+
+  if (c.slavefd >= 0)
+  {
+    close(c.slavefd);
+  }
+
+  if (c.link[0])
+  {
+    unlink(c.link);
+  }
+
+  c.fd = -1;
+  c.slavefd = -1;
+}
+
+
+//---------------------------------------------------------------------------
+// Create a pseudo terminal for a client
+//
+// The bridge keeps the slave side open too. Otherwise the master side
+// would report a hangup as long as no program has the slave side open.
+// Because of that, the client never really disconnects; its outputs are
+// dropped when it stops sending commands.
+static bool                           // Returns false on error
+AddPty(
+  const char *link)                   // Symbolic link to create, or NULL
+{
+  Client *c = NewClient();
+
+  if (!c)
+  {
+    Log("Too many clients");
+    return false;
+  }
+
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if ((fd < 0) || (grantpt(fd) < 0) || (unlockpt(fd) < 0))
+  {
+    Log("Can't create pseudo terminal: %s", strerror(errno));
+    return false;
+  }
+
+  const char *name = ptsname(fd);
+
+  // Raw mode, so that the bytes of the protocol go through unchanged
+  struct termios t;
+
+  tcgetattr(fd, &t);
+  cfmakeraw(&t);
+  tcsetattr(fd, TCSANOW, &t);
+
+  c->slavefd = open(name, O_RDWR | O_NOCTTY);
+  c->fd = fd;
+  snprintf(c->name, sizeof(c->name), "%s", name);
+  SetNonBlocking(fd);
+
+  if (link)
+  {
+    unlink(link);
+
+    if (symlink(name, link) < 0)
+    {
+      Log("Can't create link %s: %s", link, strerror(errno));
+      CloseClient(*c);
+      return false;
+    }
+
+    snprintf(c->link, sizeof(c->link), "%s", link);
+  }
+
+  printf("%s%s%s\n", name, link ? " " : "", link ? link : "");
+  fflush(stdout);
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Create a Unix domain socket for clients to connect to
+static bool                           // Returns false on error
+Listen(
+  const char *path)                   // Path of socket
+{
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+  {
+    Log("Socket path too long: %s", path);
+    return false;
+  }
+
+  strcpy(addr.sun_path, path);
+
+  s_listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+
+  if ((s_listenfd < 0)
+    || (bind(s_listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    || (listen(s_listenfd, MaxClients) < 0))
+  {
+    Log("Can't listen on %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  snprintf(s_socketpath, sizeof(s_socketpath), "%s", path);
+  SetNonBlocking(s_listenfd);
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Accept a client on the Unix socket
+static void Accept()
+{
+  int fd = accept(s_listenfd, NULL, NULL);
+
+  if (fd < 0)
+  {
+    return;
+  }
+
+  Client *c = NewClient();
+
+  if (!c)
+  {
+    Log("Too many clients");
+    close(fd);
+    return;
+  }
+
+  static unsigned count;
+
+  c->fd = fd;
+  c->socket = true;
+  snprintf(c->name, sizeof(c->name), "client %u", ++count);
+  SetNonBlocking(fd);
+
+  Log("%s: connected", c->name);
+}
+
+
+//---------------------------------------------------------------------------
+// Process the bytes that a client sent
+static void ClientInput(
+  Client &c)                          // Client
+{
+  byte buf[64];
+  ssize_t n = read(c.fd, buf, sizeof(buf));
+
+  if (n <= 0)
+  {
+    if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+    {
+      if (c.socket)
+      {
+        CloseClient(c);
+      }
+    }
+
+    return;
+  }
+
+  unsigned long now = Now();
+
+  for (ssize_t i = 0; i < n; i++)
+  {
+    byte b = buf[i];
+
+    // A client that's waiting for a reply shouldn't send anything else;
+    // whatever it sends is used after the reply.
+    if (!c.rxlen)
+    {
+      if (b == CmdIdentify)
+      {
+        // Answer this ourselves, the Arduino doesn't need to know
+        WriteAll(c.fd, &b, 1);
+        continue;
+      }
+
+      if ((b < CmdFirst) || (b > CmdLast))
+      {
+        // Unknown command; ignored, same as the Arduino does
+        continue;
+      }
+    }
+
+    c.rx[c.rxlen++] = b;
+    c.rxtime = now;
+
+    byte num = ((c.rx[0] - 1) & 3) + 1;
+
+    if (c.rxlen == 1 + num)
+    {
+      if (c.pending)
+      {
+        Log("%s: command before reply, dropped", c.name);
+      }
+
+      memset(c.outputs, 0, sizeof(c.outputs));
+      memcpy(c.outputs, c.rx + 1, num);
+      c.num = num;
+      c.analog = (c.rx[0] - CmdFirst) >> 2;
+      c.lasttime = now;
+      c.pending = true;
+      c.rxlen = 0;
+    }
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// BACKEND
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Open a serial port with the Arduino on it
+static bool                           // Returns false on error
+OpenDevice(
+  const char *path,                   // Device, e.g. /dev/ttyACM0
+  unsigned startupdelay)              // ms to wait for the Arduino
+{
+  int fd = open(path, O_RDWR | O_NOCTTY);
+
+  if (fd < 0)
+  {
+    Log("Can't open %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  // 9600 baud, 8 data bits, no parity, 1 stop bit, raw
+  struct termios t;
+
+  tcgetattr(fd, &t);
+  cfmakeraw(&t);
+  cfsetispeed(&t, B9600);
+  cfsetospeed(&t, B9600);
+  t.c_cflag |= CLOCAL | CREAD;
+  t.c_cflag &= ~(CSTOPB | CRTSCTS);
+  tcsetattr(fd, TCSANOW, &t);
+
+  // Most Arduinos reset when the serial port is opened
+  usleep(startupdelay * 1000UL);
+  tcflush(fd, TCIOFLUSH);
+
+  SetNonBlocking(fd);
+  s_backin = fd;
+  s_backout = fd;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Start a program that runs the sketch in the simulation
+static bool                           // Returns false on error
+StartSimulation(
+  const char *command)                // Shell command
+{
+  int tochild[2];
+  int fromchild[2];
+
+  if ((pipe(tochild) < 0) || (pipe(fromchild) < 0))
+  {
+    Log("Can't create pipes: %s", strerror(errno));
+    return false;
+  }
+
+  s_child = fork();
+
+  if (s_child < 0)
+  {
+    Log("Can't start %s: %s", command, strerror(errno));
+    return false;
+  }
+
+  if (!s_child)
+  {
+    dup2(tochild[0], 0);
+    dup2(fromchild[1], 1);
+    close(tochild[0]);
+    close(tochild[1]);
+    close(fromchild[0]);
+    close(fromchild[1]);
+
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+
+  close(tochild[0]);
+  close(fromchild[1]);
+
+  s_backout = tochild[1];
+  s_backin = fromchild[0];
+  SetNonBlocking(s_backin);
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Send a command to the Arduino and get the reply
+static bool                           // Returns false on timeout or error
+Transact(
+  const byte *cmd,                    // Command and motor bytes
+  size_t cmdlen,                      // Length of command
+  byte *reply,                        // Receives reply
+  size_t replylen)                    // Expected length of reply
+{
+  byte junk[64];
+
+  // Throw away anything that arrived late from an earlier command
+  while (read(s_backin, junk, sizeof(junk)) > 0)
+  {
+    // Nothing
+  }
+
+  if (!WriteAll(s_backout, cmd, cmdlen))
+  {
+    Log("Can't write to Arduino: %s", strerror(errno));
+    return false;
+  }
+
+  unsigned long start = Now();
+  size_t got = 0;
+
+  while (got < replylen)
+  {
+    long left = BackendTimeout - (long)(Now() - start);
+
+    if (left <= 0)
+    {
+      Log("No reply from Arduino");
+      return false;
+    }
+
+    struct pollfd p = { s_backin, POLLIN, 0 };
+
+    if (poll(&p, 1, left) > 0)
+    {
+      ssize_t n = read(s_backin, reply + got, replylen - got);
+
+      if (n > 0)
+      {
+        got += n;
+      }
+      else if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+      {
+        Log("Connection to Arduino lost");
+        s_quit = 1;
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// BRIDGE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Send the commands of the clients that are waiting, and reply to them
+//
+// The outputs of all clients that sent a command recently are ORed, and
+// sent for the largest number of interfaces that any of them used. Clients
+// that didn't ask for an analog input can use the reply to any command;
+// for the others, one command is sent for each analog input.
+static void Refresh()
+{
+  unsigned long now = Now();
+  byte outputs[MaxInterfaces];
+  byte num = 0;
+  bool want[NumAnalog];
+
+  memset(outputs, 0, sizeof(outputs));
+  memset(want, 0, sizeof(want));
+
+  for (unsigned u = 0; u < MaxClients; u++)
+  {
+    Client &c = s_clients[u];
+
+    if ((c.fd < 0) || ((!c.pending) && (now - c.lasttime >= ClientTimeout)))
+    {
+      continue;
+    }
+
+    for (byte v = 0; v < c.num; v++)
+    {
+      outputs[v] |= c.outputs[v];
+    }
+
+    if (c.num > num)
+    {
+      num = c.num;
+    }
+
+    if (c.pending)
+    {
+      want[c.analog] = true;
+    }
+  }
+
+  if ((want[AnalogX]) || (want[AnalogY]))
+  {
+    want[AnalogNone] = false;
+  }
+
+  bool first = true;
+
+  for (byte analog = 0; analog < NumAnalog; analog++)
+  {
+    if (!want[analog])
+    {
+      continue;
+    }
+
+    byte cmd[1 + MaxInterfaces];
+    byte reply[MaxReply];
+    size_t replylen = num + (analog ? 2 : 0);
+
+    cmd[0] = CmdFirst + (num - 1) + (analog << 2);
+    memcpy(cmd + 1, outputs, num);
+
+    bool ok = Transact(cmd, 1 + num, reply, replylen);
+
+    if (s_verbose)
+    {
+      Log("Command %02X outputs %02X %02X %02X %02X: %s",
+        cmd[0], outputs[0], outputs[1], outputs[2], outputs[3],
+        ok ? "ok" : "failed");
+    }
+
+    // Reply to the clients. If there was no reply, they don't get one
+    // either, and they'll retry.
+    for (unsigned u = 0; u < MaxClients; u++)
+    {
+      Client &c = s_clients[u];
+
+      if ((c.fd < 0) || (!c.pending)
+        || ((c.analog != analog) && ((c.analog) || (!first))))
+      {
+        continue;
+      }
+
+      c.pending = false;
+
+      if (ok)
+      {
+        byte buf[MaxReply];
+        size_t len = c.num;
+
+        memcpy(buf, reply, c.num);
+
+        if (c.analog)
+        {
+          buf[len++] = reply[num];
+          buf[len++] = reply[num + 1];
+        }
+
+        if ((!WriteAll(c.fd, buf, len)) && (c.socket))
+        {
+          CloseClient(c);
+        }
+      }
+    }
+
+    first = false;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Main loop
+static void Run()
+{
+  while (!s_quit)
+  {
+    struct pollfd fds[1 + MaxClients];
+    Client *clients[1 + MaxClients];
+    nfds_t n = 0;
+
+    if (s_listenfd >= 0)
+    {
+      fds[n].fd = s_listenfd;
+      fds[n].events = POLLIN;
+      clients[n++] = NULL;
+    }
+
+    for (unsigned u = 0; u < MaxClients; u++)
+    {
+      if (s_clients[u].fd >= 0)
+      {
+        fds[n].fd = s_clients[u].fd;
+        fds[n].events = POLLIN;
+        clients[n++] = &s_clients[u];
+      }
+    }
+
+    if (poll(fds, n, PollInterval) > 0)
+    {
+      for (nfds_t i = 0; i < n; i++)
+      {
+        if (fds[i].revents)
+        {
+          if (clients[i])
+          {
+            ClientInput(*clients[i]);
+          }
+          else
+          {
+            Accept();
+          }
+        }
+      }
+    }
+
+    // Throw partial commands away if the rest doesn't arrive
+    unsigned long now = Now();
+
+    for (unsigned u = 0; u < MaxClients; u++)
+    {
+      Client &c = s_clients[u];
+
+      if ((c.fd >= 0) && (c.rxlen) && (now - c.rxtime >= GapTimeout))
+      {
+        Log("%s: partial command dropped", c.name);
+        c.rxlen = 0;
+      }
+    }
+
+    Refresh();
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Signal handler
+static void OnSignal(
+  int sig)
+{
+  (void)sig;
+
+  s_quit = 1;
+}
+
+
+//---------------------------------------------------------------------------
+// Print usage information
+static void Usage(
+  const char *name)                   // Program name
+{
+  fprintf(stderr,
+    "Usage: %s [options] (-d device | -s command)\n"
+    "  -d device   Serial port with Fishduino_Ser, e.g. /dev/ttyACM0\n"
+    "  -s command  Run command (a simulated Fishduino_Ser) instead\n"
+    "  -w ms       Time to wait for the Arduino to start (default %u)\n"
+    "  -t          Create a pseudo terminal for a client\n"
+    "  -T link     Create a pseudo terminal with a symbolic link to it\n"
+    "  -u path     Accept clients on a Unix domain socket\n"
+    "  -v          Log every command to the Arduino\n"
+    "-t and -T can be used more than once. The names of the pseudo\n"
+    "terminals are printed on stdout.\n",
+    name, DefaultStartupDelay);
+}
+
+
+//---------------------------------------------------------------------------
+// Main program
+int main(
+  int argc,
+  char *argv[])
+{
+  const char *device = NULL;
+  const char *command = NULL;
+  unsigned startupdelay = DefaultStartupDelay;
+  bool ok = true;
+  int opt;
+
+  for (unsigned u = 0; u < MaxClients; u++)
+  {
+    s_clients[u].fd = -1;
+    s_clients[u].slavefd = -1;
+  }
+
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  while ((ok) && ((opt = getopt(argc, argv, "d:s:w:tT:u:v")) != -1))
+  {
+    switch (opt)
+    {
+    case 'd':
+      device = optarg;
+      break;
+
+    case 's':
+      command = optarg;
+      break;
+
+    case 'w':
+      startupdelay = strtoul(optarg, NULL, 0);
+      break;
+
+    case 't':
+      ok = AddPty(NULL);
+      break;
+
+    case 'T':
+      ok = AddPty(optarg);
+      break;
+
+    case 'u':
+      ok = Listen(optarg);
+      break;
+
+    case 'v':
+      s_verbose = true;
+      break;
+
+    default:
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if ((ok) && ((!device) == (!command)))
+  {
+    Usage(argv[0]);
+    ok = false;
+  }
+
+  if (ok)
+  {
+    ok = device ? OpenDevice(device, startupdelay) : StartSimulation(command);
+  }
+
+  if (ok)
+  {
+    Run();
+  }
+
+  // Clean up
+  for (unsigned u = 0; u < MaxClients; u++)
+  {
+    CloseClient(s_clients[u]);
+  }
+
+  if (s_listenfd >= 0)
+  {
+    close(s_listenfd);
+    unlink(s_socketpath);
+  }
+
+  if (s_child > 0)
+  {
+    kill(s_child, SIGTERM);
+    waitpid(s_child, NULL, 0);
+  }
+
+  return ok ? 0 : 1;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,299 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  Fake Arduino core for the host-side simulation.
+
+  This declares the parts of the Arduino API that the library and the
+  example sketches use. The functions are implemented in SimArduino.cpp on
+  top of the simulated pins and clock; see Sim.h.
+
+  There's no __AVR__ here, so the library uses digitalWrite and
+  digitalRead instead of the port registers, and the hardware SPI and
+  Timer1 code is left out. FishduinoFast uses digitalWriteFast and
+  digitalReadFast instead, which cost about as much time as the single
+  instructions that it uses on an AVR.
+*/
+
+
+#ifndef _SIM_ARDUINO_H_
+#define _SIM_ARDUINO_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define NOT_AN_INTERRUPT -1
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define _BV(bit) (1 << (bit))
+#define bit(b) (1UL << (b))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void *const *)(addr))
+#define F(string_literal) (string_literal)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Digital I/O
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// Single-instruction pin access, the same as the macros of the
+// digitalWriteFast library on a real Arduino
+void SimDigitalWriteFast(uint8_t pin, uint8_t val);
+int SimDigitalReadFast(uint8_t pin);
+#define digitalWriteFast(pin, val) SimDigitalWriteFast(pin, val)
+#define digitalReadFast(pin) SimDigitalReadFast(pin)
+
+// Time
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Interrupts; pins 2 and 3 have external interrupts 0 and 1, like on an Uno
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts();
+void interrupts();
+
+// Random numbers
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Sketch
+void setup();
+void loop();
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SERIAL PORT
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Simulated serial port
+//
+// By default, the serial port reads from stdin and writes to stdout, so a
+// sketch that talks to a PC program can be connected to that program
+// through a pipe or a pseudo terminal. Input is not blocking: if there's
+// nothing on stdin, read returns -1.
+class SimSerial
+{
+protected:
+  int               m_infd;             // File descriptor to read from
+  int               m_outfd;            // File descriptor to write to
+  unsigned long     m_baud;             // Baud rate, 0=not started
+  int               m_peek;             // Byte read ahead, -1=none
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  SimSerial(
+    int infd = 0,                       // Input file descriptor
+    int outfd = 1);                     // Output file descriptor
+
+public:
+  //-------------------------------------------------------------------------
+  // Start the serial port
+  void
+  begin(
+    unsigned long baud);                // Baud rate (only stored)
+
+public:
+  //-------------------------------------------------------------------------
+  // Stop the serial port
+  void
+  end();
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the serial port is ready
+  operator bool()
+  {
+    return true;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the baud rate that was passed to begin
+  unsigned long                         // Returns baud rate, 0=not started
+  baud()
+  {
+    return m_baud;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of bytes that can be read (0 or 1, no buffering)
+  int                                   // Returns number of bytes
+  available();
+
+public:
+  //-------------------------------------------------------------------------
+  // Read a byte
+  int                                   // Returns byte or -1 if none
+  read();
+
+public:
+  //-------------------------------------------------------------------------
+  // Look at the next byte without reading it
+  int                                   // Returns byte or -1 if none
+  peek();
+
+public:
+  //-------------------------------------------------------------------------
+  // Wait until all output is sent
+  void
+  flush();
+
+public:
+  //-------------------------------------------------------------------------
+  // Write bytes
+  size_t                                // Returns number of bytes written
+  write(
+    const uint8_t *buffer,              // Data to write
+    size_t size);                       // Number of bytes
+
+public:
+  //-------------------------------------------------------------------------
+  // Write a byte
+  size_t                                // Returns number of bytes written
+  write(
+    uint8_t c)                          // Byte to write
+  {
+    return write(&c, 1);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Write a string
+  size_t                                // Returns number of bytes written
+  write(
+    const char *s)                      // String to write
+  {
+    return write((const uint8_t *)s, strlen(s));
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Print functions, same as the Arduino Print class
+  size_t print(const char *s)           { return write(s); }
+  size_t print(char c)                  { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC)   { return print((long)n, base); }
+  size_t print(unsigned n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println()                      { return write("\r\n"); }
+
+  template <class T>
+  size_t println(T value)               { return print(value) + println(); }
+
+  template <class T>
+  size_t println(T value, int format)   { return print(value, format) + println(); }
+};
+
+
+extern SimSerial Serial;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
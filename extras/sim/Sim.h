@@ -0,0 +1,222 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  Host-side simulation of an Arduino, for running the library and the
+  example sketches on a Linux (or other POSIX) computer.
+
+  The fake Arduino core (Arduino.h, SimArduino.cpp) keeps the level and
+  mode of every pin and a simulated clock. Every call to the core costs a
+  number of simulated CPU cycles (see Sim::Cost), so code that busy-waits
+  on micros() or millis() makes progress, and the time that a function
+  takes can be measured in cycles.
+
+  Simulated hardware is connected to the pins by deriving a class from
+  SimDevice and attaching an instance with Sim::Attach. See Sim30520.h for
+  a model of the fischertechnik 30520 interface.
+
+  See README.md for how to build and run.
+*/
+
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Arduino.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SIMULATED DEVICE
+/////////////////////////////////////////////////////////////////////////////
+
+
+class SimDevice
+{
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  virtual ~SimDevice()
+  {
+    // Nothing to do here
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Notification that the Arduino changed the level of an output pin
+  virtual void
+  PinChanged(
+    byte pin,                           // Arduino pin number
+    bool level)                         // New level, true=HIGH
+  {
+    (void)pin;
+    (void)level;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the level that the device drives onto a pin
+  //
+  // Return false if the device doesn't drive the pin.
+  virtual bool                          // Returns true if level was set
+  PinLevel(
+    byte pin,                           // Arduino pin number
+    bool &level)                        // Receives level, true=HIGH
+  {
+    (void)pin;
+    (void)level;
+
+    return false;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Notification that the simulated time advanced
+  virtual void
+  Advance(
+    unsigned long us)                   // Current time (microseconds)
+  {
+    (void)us;
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SIMULATION CONTROL
+/////////////////////////////////////////////////////////////////////////////
+
+
+class Sim
+{
+public:
+  // Miscellaneous constants
+  enum
+  {
+    NumPins = 64,                       // Number of simulated pins
+    MaxDevices = 8,                     // Max number of attached devices
+  };
+
+  // Simulated cost of the core functions in CPU cycles. These are rough
+  // numbers for an ATmega328P with the standard Arduino core, so that
+  // simulated timing is in the right ballpark; they're not exact.
+  enum Cost
+  {
+    CostPinMode = 60,
+    CostDigitalWrite = 60,
+    CostDigitalRead = 50,
+    CostDigitalWriteFast = 2,
+    CostDigitalReadFast = 2,
+    CostMicros = 30,
+    CostMillis = 20,
+    CostInterrupts = 2,
+    CostSerial = 20,
+    CostLoop = 10,
+  };
+
+  // Counters of calls to the core, see GetCounters
+  struct Counters
+  {
+    unsigned long   pinmodes;           // Calls to pinMode
+    unsigned long   pinwrites;          // Calls to digitalWrite
+    unsigned long   pinreads;           // Calls to digitalRead
+    unsigned long   interrupts;         // Interrupt handlers called
+  };
+
+public:
+  //-------------------------------------------------------------------------
+  // Attach a simulated device to the pins
+  static bool                           // Returns false if too many devices
+  Attach(
+    SimDevice &device);                 // Device to attach
+
+public:
+  //-------------------------------------------------------------------------
+  // Detach a simulated device
+  static void
+  Detach(
+    SimDevice &device);                 // Device to detach
+
+public:
+  //-------------------------------------------------------------------------
+  // Let simulated time pass
+  //
+  // The devices are notified, and interrupt handlers are called for pins
+  // of which the level changed.
+  static void
+  Spend(
+    unsigned long cycles);              // Number of CPU cycles
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of CPU cycles since the start of the simulation
+  static unsigned long long             // Returns number of cycles
+  Cycles();
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the simulated time in microseconds
+  static unsigned long                  // Returns time (us)
+  Micros();
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the level of a pin as the Arduino would read it
+  //
+  // This doesn't cost any simulated time.
+  static bool                           // Returns true=HIGH
+  PinLevel(
+    byte pin);                          // Arduino pin number
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the call counters
+  static Counters                       // Returns copy of counters
+  GetCounters();
+
+public:
+  //-------------------------------------------------------------------------
+  // Reset the call counters
+  static void
+  ResetCounters();
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
@@ -0,0 +1,292 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+#include "Sim30520.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Initialize
+void
+Sim30520::Init(
+  byte num_interfaces,
+  byte pin_datacountin,
+  byte pin_triggerx,
+  byte pin_triggery,
+  byte pin_dataout,
+  byte pin_clock,
+  byte pin_loadout,
+  byte pin_loadin)
+{
+  m_pin[DATACOUNTIN]  = pin_datacountin;
+  m_pin[TRIGGERX]     = pin_triggerx;
+  m_pin[TRIGGERY]     = pin_triggery;
+  m_pin[DATAOUT]      = pin_dataout;
+  m_pin[CLOCK]        = pin_clock;
+  m_pin[LOADOUT]      = pin_loadout;
+  m_pin[LOADIN]       = pin_loadin;
+
+  m_num_interfaces = constrain(num_interfaces, 1, MaxInterfaces);
+
+  // The Arduino pins are inputs at power-up; the triggers have pull-ups
+  memset(m_level, 0, sizeof(m_level));
+  m_level[TRIGGERX] = true;
+  m_level[TRIGGERY] = true;
+
+  memset(m_outshift, 0, sizeof(m_outshift));
+  memset(m_outlatch, 0, sizeof(m_outlatch));
+  memset(m_inshift, 0, sizeof(m_inshift));
+  memset(m_inputs, 0, sizeof(m_inputs));
+
+  for (byte u = 0; u < 2; u++)
+  {
+    m_analog[u] = DefaultAnalog;
+    m_timerend[u] = 0;
+    m_timerrunning[u] = false;
+  }
+
+  m_now = Sim::Micros();
+  m_laststrobe = m_now;
+  m_timedout = false;
+
+  ResetCounters();
+
+  Sim::Attach(*this);
+}
+
+
+//---------------------------------------------------------------------------
+// Constructor
+Sim30520::Sim30520(
+  byte pin_datacountin,
+  byte pin_triggerx,
+  byte pin_triggery,
+  byte pin_dataout,
+  byte pin_clock,
+  byte pin_loadout,
+  byte pin_loadin,
+  byte num_interfaces)
+{
+  Init(
+    num_interfaces,
+    pin_datacountin,
+    pin_triggerx,
+    pin_triggery,
+    pin_dataout,
+    pin_clock,
+    pin_loadout,
+    pin_loadin);
+}
+
+
+//---------------------------------------------------------------------------
+// Simpler constructor for when connected to consecutive Arduino pins
+Sim30520::Sim30520(
+  byte startpin,
+  byte num_interfaces)
+{
+  Init(
+    num_interfaces,
+    startpin,
+    startpin + 1,
+    startpin + 2,
+    startpin + 3,
+    startpin + 4,
+    startpin + 5,
+    startpin + 6);
+}
+
+
+//---------------------------------------------------------------------------
+// Destructor
+Sim30520::~Sim30520()
+{
+  Sim::Detach(*this);
+}
+
+
+//---------------------------------------------------------------------------
+// Check if a timer output is HIGH
+bool                                  // Returns true=timer running
+Sim30520::TimerOutput(
+  byte index)                         // 0=X, 1=Y
+{
+  // The output stays HIGH as long as the trigger input is LOW
+  if (!m_level[TRIGGERX + index])
+  {
+    return true;
+  }
+
+  if (m_timerrunning[index])
+  {
+    if ((m_analog[index] != Disconnected) && ((long)(m_now - m_timerend[index]) >= 0))
+    {
+      m_timerrunning[index] = false;
+    }
+  }
+
+  return m_timerrunning[index];
+}
+
+
+//---------------------------------------------------------------------------
+// Handle a rising edge of the clock
+void
+Sim30520::Clock()
+{
+  m_counters.clocks++;
+
+  // Output shift registers: DATA OUT goes into the first interface, and
+  // the last bit of each interface goes into the next one.
+  for (byte u = m_num_interfaces; u-- > 0; )
+  {
+    bool in = u ? ((m_outshift[u - 1] & 0x80) != 0) : m_level[DATAOUT];
+
+    m_outshift[u] = (m_outshift[u] << 1) | in;
+  }
+
+  // Input shift registers: load the inputs in parallel mode, otherwise
+  // shift towards the first interface. The serial input of the last one
+  // is pulled down.
+  if (m_level[LOADIN])
+  {
+    memcpy(m_inshift, m_inputs, m_num_interfaces);
+    m_counters.loads++;
+  }
+  else
+  {
+    for (byte u = 0; u < m_num_interfaces; u++)
+    {
+      bool in = (u + 1 < m_num_interfaces) ? ((m_inshift[u + 1] & 0x80) != 0) : false;
+
+      m_inshift[u] = (m_inshift[u] << 1) | in;
+    }
+  }
+
+  // The output latches are transparent while LOAD OUT is HIGH
+  if (m_level[LOADOUT])
+  {
+    memcpy(m_outlatch, m_outshift, m_num_interfaces);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Notification that the Arduino changed the level of an output pin
+void
+Sim30520::PinChanged(
+  byte pin,                           // Arduino pin number
+  bool level)                         // New level, true=HIGH
+{
+  for (byte u = TRIGGERX; u < NumPins; u++)
+  {
+    if (m_pin[u] == pin)
+    {
+      bool old = m_level[u];
+
+      // A timer that's already running isn't retriggered
+      bool running = ((u == TRIGGERX) || (u == TRIGGERY)) && (TimerOutput(u - TRIGGERX));
+
+      m_level[u] = level;
+
+      if ((u == CLOCK) && (level) && (!old))
+      {
+        Clock();
+      }
+      else if ((u == LOADOUT) && (level) && (!old))
+      {
+        memcpy(m_outlatch, m_outshift, m_num_interfaces);
+
+        m_counters.strobes++;
+        m_laststrobe = m_now;
+        m_timedout = false;
+      }
+      else if (((u == TRIGGERX) || (u == TRIGGERY)) && (!level) && (old))
+      {
+        byte index = u - TRIGGERX;
+
+        if (!running)
+        {
+          m_timerend[index] = m_now + m_analog[index];
+          m_timerrunning[index] = true;
+          m_counters.triggers++;
+        }
+      }
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the level that the device drives onto a pin
+bool                                  // Returns true if level was set
+Sim30520::PinLevel(
+  byte pin,                           // Arduino pin number
+  bool &level)                        // Receives level, true=HIGH
+{
+  if (pin != m_pin[DATACOUNTIN])
+  {
+    return false;
+  }
+
+  level = !((m_inshift[0] & 0x80) || TimerOutput(0) || TimerOutput(1));
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Notification that the simulated time advanced
+void
+Sim30520::Advance(
+  unsigned long us)                   // Current time (microseconds)
+{
+  m_now = us;
+
+  if ((!m_timedout) && (m_now - m_laststrobe >= WatchdogTimeout * 1000UL))
+  {
+    m_timedout = true;
+
+    // Only count it if there was something to turn off
+    for (byte u = 0; u < m_num_interfaces; u++)
+    {
+      if (m_outlatch[u])
+      {
+        m_counters.timeouts++;
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,280 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  Simulation of the fischertechnik 30520 parallel interface, for use with
+  the host-side simulation (see Sim.h).
+
+  The model works at the level of the chips on the interface:
+  - The outputs go through a 4094 shift register: DATA OUT is shifted in at
+    the rising edge of CLOCK, and the shift register is copied to the
+    outputs while LOAD OUT is HIGH.
+  - The inputs come from a 4014 shift register: at the rising edge of
+    CLOCK, the inputs are loaded if LOAD IN is HIGH, otherwise the register
+    shifts. Input I8 comes out first.
+  - DATA/COUNT IN is the inverted OR of the serial output of the input
+    shift register and the outputs of the two 556 timers. A timer output
+    goes HIGH when its TRIGGER line goes LOW, and stays HIGH for the time
+    that's set with SetAnalog (and at least as long as TRIGGER is LOW).
+  - Interfaces can be cascaded: the outputs of the shift registers of each
+    interface go to the next one, and the serial input of the input shift
+    register of the last interface is pulled down. Only the analog inputs
+    of the first interface can be read.
+  - The outputs are turned off when LOAD OUT hasn't been pulsed for
+    WatchdogTimeout milliseconds.
+*/
+
+
+#ifndef _SIM30520_H_
+#define _SIM30520_H_
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Sim.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SIMULATED 30520 INTERFACE
+/////////////////////////////////////////////////////////////////////////////
+
+
+class Sim30520 : public SimDevice
+{
+public:
+  // Miscellaneous constants
+  enum
+  {
+    MaxInterfaces = 8,                  // Max number of cascaded interfaces
+    WatchdogTimeout = 500,              // Output timeout (ms)
+    DefaultAnalog = 1000,               // Default analog timer time (us)
+    Disconnected = 0,                   // Analog time: no potentiometer
+  };
+
+  // Pin indexes, same order as in the Fishduino class
+  enum
+  {
+    DATACOUNTIN,
+    TRIGGERX,
+    TRIGGERY,
+    DATAOUT,
+    CLOCK,
+    LOADOUT,
+    LOADIN,
+
+    // Helper
+    NumPins
+  };
+
+  // Event counters, see GetCounters
+  struct Counters
+  {
+    unsigned long   clocks;             // Rising edges of CLOCK
+    unsigned long   strobes;            // Rising edges of LOAD OUT
+    unsigned long   loads;              // Clock edges that loaded inputs
+    unsigned long   triggers;           // Analog timers triggered
+    unsigned long   timeouts;           // Outputs turned off by watchdog
+  };
+
+protected:
+  byte              m_pin[NumPins];     // Arduino pin for each signal
+  bool              m_level[NumPins];   // Level of the Arduino outputs
+  byte              m_num_interfaces;   // Number of cascaded interfaces
+
+  byte              m_outshift[MaxInterfaces]; // Output shift registers
+  byte              m_outlatch[MaxInterfaces]; // Output latches
+  byte              m_inshift[MaxInterfaces]; // Input shift registers
+  byte              m_inputs[MaxInterfaces]; // Input switches
+
+  unsigned          m_analog[2];        // Timer time (us), 0=disconnected
+  unsigned long     m_timerend[2];      // End of timer pulse (us)
+  bool              m_timerrunning[2];  // True=timer pulse started
+
+  unsigned long     m_now;              // Current time (us)
+  unsigned long     m_laststrobe;       // Time of last LOAD OUT pulse (us)
+  bool              m_timedout;         // True=outputs turned off
+
+  Counters          m_counters;         // Event counters
+
+private:
+  //-------------------------------------------------------------------------
+  // Private function called during construction
+  void Init(
+    byte num_interfaces,
+    byte pin_datacountin,
+    byte pin_triggerx,
+    byte pin_triggery,
+    byte pin_dataout,
+    byte pin_clock,
+    byte pin_loadout,
+    byte pin_loadin);
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  //
+  // The device attaches itself to the simulated Arduino.
+  Sim30520(
+    byte pin_datacountin,
+    byte pin_triggerx,
+    byte pin_triggery,
+    byte pin_dataout,
+    byte pin_clock,
+    byte pin_loadout,
+    byte pin_loadin,
+    byte num_interfaces = 1);
+
+public:
+  //-------------------------------------------------------------------------
+  // Simpler constructor for when connected to consecutive Arduino pins
+  Sim30520(
+    byte startpin = 2,
+    byte num_interfaces = 1);
+
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  virtual ~Sim30520();
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the inputs of an interface
+  void
+  SetInputs(
+    byte intindex,                      // Interface index, 0=first
+    byte value)                         // Input bits, bit 0 is I1
+  {
+    if (intindex < m_num_interfaces)
+    {
+      m_inputs[intindex] = value;
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set one input of an interface
+  void
+  SetInputPin(
+    byte intindex,                      // Interface index, 0=first
+    byte pin,                           // Input pin, 0=I1
+    bool value)                         // True=on
+  {
+    if (intindex < m_num_interfaces)
+    {
+      m_inputs[intindex] = (m_inputs[intindex] & ~(1 << pin)) | (value << pin);
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the outputs of an interface
+  //
+  // This is 0 if the outputs were turned off by the watchdog.
+  byte                                  // Returns output bits, bit 0 is O1
+  GetOutputs(
+    byte intindex)                      // Interface index, 0=first
+  {
+    return ((intindex < m_num_interfaces) && (!m_timedout)) ? m_outlatch[intindex] : 0;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the outputs were turned off by the watchdog
+  bool                                  // Returns true=timed out
+  IsTimedOut()
+  {
+    return m_timedout;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set the time of an analog timer
+  //
+  // The time is what a real interface would generate with the
+  // potentiometer that's attached. Disconnected means no potentiometer; the
+  // timer pulse never ends.
+  void
+  SetAnalog(
+    byte index,                         // 0=X, 1=Y
+    unsigned us)                        // Time (us), Disconnected=none
+  {
+    m_analog[index ? 1 : 0] = us;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the event counters
+  Counters                              // Returns copy of counters
+  GetCounters()
+  {
+    return m_counters;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Reset the event counters
+  void
+  ResetCounters()
+  {
+    memset(&m_counters, 0, sizeof(m_counters));
+  }
+
+protected:
+  //-------------------------------------------------------------------------
+  // Check if a timer output is HIGH
+  bool                                  // Returns true=timer running
+  TimerOutput(
+    byte index);                        // 0=X, 1=Y
+
+protected:
+  //-------------------------------------------------------------------------
+  // Handle a rising edge of the clock
+  void
+  Clock();
+
+public:
+  //-------------------------------------------------------------------------
+  // SimDevice overrides
+  virtual void PinChanged(byte pin, bool level);
+  virtual bool PinLevel(byte pin, bool &level);
+  virtual void Advance(unsigned long us);
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif
@@ -0,0 +1,704 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "Sim.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Attached devices
+static SimDevice   *s_device[Sim::MaxDevices];
+static byte         s_num_devices;
+
+// Pin state
+static byte         s_mode[Sim::NumPins];   // INPUT, OUTPUT or INPUT_PULLUP
+static bool         s_level[Sim::NumPins];  // Output level or pull-up
+
+// Simulated time
+static unsigned long long s_cycles;
+
+// Interrupts
+static bool         s_enabled = true;   // False=noInterrupts
+static bool         s_inisr;            // True=handler running
+static void       (*s_isr[2])(void);    // Handlers for pins 2 and 3
+static int          s_isrmode[2];       // RISING, FALLING or CHANGE
+static bool         s_isrlevel[2];      // Level at the last check
+static bool         s_isrpending[2];    // Edge seen, handler not called yet
+
+// Statistics
+static Sim::Counters s_counters;
+
+// Serial port
+SimSerial Serial;
+static int          s_savedflags = -1;  // File flags of stdin at begin()
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SIMULATION CONTROL
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Call interrupt handlers that are pending, if interrupts are enabled
+static void RunInterrupts()
+{
+  if ((s_enabled) && (!s_inisr))
+  {
+    for (byte i = 0; i < 2; i++)
+    {
+      if ((s_isrpending[i]) && (s_isr[i]))
+      {
+        s_isrpending[i] = false;
+
+        // Handlers run with interrupts disabled, like on the real thing
+        s_inisr = true;
+        s_enabled = false;
+        s_counters.interrupts++;
+
+        s_isr[i]();
+
+        s_enabled = true;
+        s_inisr = false;
+      }
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Check the external interrupt pins for edges
+static void CheckInterrupts()
+{
+  for (byte i = 0; i < 2; i++)
+  {
+    if (s_isr[i])
+    {
+      bool level = Sim::PinLevel(2 + i);
+
+      if (level != s_isrlevel[i])
+      {
+        s_isrlevel[i] = level;
+
+        if ((s_isrmode[i] == CHANGE)
+          || ((s_isrmode[i] == RISING) && (level))
+          || ((s_isrmode[i] == FALLING) && (!level)))
+        {
+          s_isrpending[i] = true;
+        }
+      }
+    }
+  }
+
+  RunInterrupts();
+}
+
+
+//---------------------------------------------------------------------------
+// Attach a simulated device to the pins
+bool                                  // Returns false if too many devices
+Sim::Attach(
+  SimDevice &device)                  // Device to attach
+{
+  if (s_num_devices >= MaxDevices)
+  {
+    return false;
+  }
+
+  s_device[s_num_devices++] = &device;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Detach a simulated device
+void
+Sim::Detach(
+  SimDevice &device)                  // Device to detach
+{
+  for (byte u = 0; u < s_num_devices; u++)
+  {
+    if (s_device[u] == &device)
+    {
+      memmove(&s_device[u], &s_device[u + 1], (s_num_devices - u - 1) * sizeof(s_device[0]));
+      s_num_devices--;
+      break;
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Let simulated time pass
+void
+Sim::Spend(
+  unsigned long cycles)               // Number of CPU cycles
+{
+  s_cycles += cycles;
+
+  unsigned long us = Micros();
+
+  for (byte u = 0; u < s_num_devices; u++)
+  {
+    s_device[u]->Advance(us);
+  }
+
+  CheckInterrupts();
+}
+
+
+//---------------------------------------------------------------------------
+// Get the number of CPU cycles since the start of the simulation
+unsigned long long                    // Returns number of cycles
+Sim::Cycles()
+{
+  return s_cycles;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the simulated time in microseconds
+unsigned long                         // Returns time (us)
+Sim::Micros()
+{
+  return (unsigned long)(s_cycles / (F_CPU / 1000000UL));
+}
+
+
+//---------------------------------------------------------------------------
+// Get the level of a pin as the Arduino would read it
+bool                                  // Returns true=HIGH
+Sim::PinLevel(
+  byte pin)                           // Arduino pin number
+{
+  bool level = false;
+
+  if (pin < NumPins)
+  {
+    // An input pin that isn't driven by any device reads as its pull-up
+    // (which is what digitalWrite sets on an input pin)
+    level = s_level[pin];
+
+    if (s_mode[pin] != OUTPUT)
+    {
+      for (byte u = 0; u < s_num_devices; u++)
+      {
+        if (s_device[u]->PinLevel(pin, level))
+        {
+          break;
+        }
+      }
+    }
+  }
+
+  return level;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the call counters
+Sim::Counters                         // Returns copy of counters
+Sim::GetCounters()
+{
+  return s_counters;
+}
+
+
+//---------------------------------------------------------------------------
+// Reset the call counters
+void
+Sim::ResetCounters()
+{
+  memset(&s_counters, 0, sizeof(s_counters));
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// ARDUINO CORE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Set the mode of a pin
+void pinMode(
+  uint8_t pin,
+  uint8_t mode)
+{
+  s_counters.pinmodes++;
+
+  if (pin < Sim::NumPins)
+  {
+    s_mode[pin] = mode;
+
+    if (mode == INPUT_PULLUP)
+    {
+      s_level[pin] = true;
+    }
+
+    // The pin starts driving the level that was written to it before
+    if (mode == OUTPUT)
+    {
+      for (byte u = 0; u < s_num_devices; u++)
+      {
+        s_device[u]->PinChanged(pin, s_level[pin]);
+      }
+    }
+  }
+
+  Sim::Spend(Sim::CostPinMode);
+}
+
+
+//---------------------------------------------------------------------------
+// Change the level of a pin and notify the devices
+static void WritePin(
+  uint8_t pin,
+  uint8_t val)
+{
+  s_counters.pinwrites++;
+
+  if (pin < Sim::NumPins)
+  {
+    bool level = (val != LOW);
+
+    if (s_level[pin] != level)
+    {
+      s_level[pin] = level;
+
+      if (s_mode[pin] == OUTPUT)
+      {
+        for (byte u = 0; u < s_num_devices; u++)
+        {
+          s_device[u]->PinChanged(pin, level);
+        }
+      }
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Set the level of an output pin (or the pull-up of an input pin)
+void digitalWrite(
+  uint8_t pin,
+  uint8_t val)
+{
+  WritePin(pin, val);
+
+  Sim::Spend(Sim::CostDigitalWrite);
+}
+
+
+//---------------------------------------------------------------------------
+// Set the level of an output pin with a single instruction
+void SimDigitalWriteFast(
+  uint8_t pin,
+  uint8_t val)
+{
+  WritePin(pin, val);
+
+  Sim::Spend(Sim::CostDigitalWriteFast);
+}
+
+
+//---------------------------------------------------------------------------
+// Read the level of a pin
+int digitalRead(
+  uint8_t pin)
+{
+  s_counters.pinreads++;
+
+  Sim::Spend(Sim::CostDigitalRead);
+
+  return Sim::PinLevel(pin) ? HIGH : LOW;
+}
+
+
+//---------------------------------------------------------------------------
+// Read the level of a pin with a single instruction
+int SimDigitalReadFast(
+  uint8_t pin)
+{
+  s_counters.pinreads++;
+
+  Sim::Spend(Sim::CostDigitalReadFast);
+
+  return Sim::PinLevel(pin) ? HIGH : LOW;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the time in milliseconds
+unsigned long millis()
+{
+  Sim::Spend(Sim::CostMillis);
+
+  return Sim::Micros() / 1000;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the time in microseconds
+unsigned long micros()
+{
+  Sim::Spend(Sim::CostMicros);
+
+  return Sim::Micros();
+}
+
+
+//---------------------------------------------------------------------------
+// Wait a number of milliseconds
+void delay(
+  unsigned long ms)
+{
+  // Spend the time in small steps, so the devices see it pass
+  while (ms--)
+  {
+    Sim::Spend(F_CPU / 1000);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Wait a number of microseconds
+void delayMicroseconds(
+  unsigned int us)
+{
+  Sim::Spend(us * (F_CPU / 1000000UL));
+}
+
+
+//---------------------------------------------------------------------------
+// Get the external interrupt number of a pin
+int digitalPinToInterrupt(
+  uint8_t pin)
+{
+  return ((pin == 2) || (pin == 3)) ? pin - 2 : NOT_AN_INTERRUPT;
+}
+
+
+//---------------------------------------------------------------------------
+// Attach an external interrupt handler
+void attachInterrupt(
+  uint8_t interrupt,
+  void (*isr)(void),
+  int mode)
+{
+  if (interrupt < 2)
+  {
+    s_isrlevel[interrupt] = Sim::PinLevel(2 + interrupt);
+    s_isrmode[interrupt] = mode;
+    s_isr[interrupt] = isr;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Detach an external interrupt handler
+void detachInterrupt(
+  uint8_t interrupt)
+{
+  if (interrupt < 2)
+  {
+    s_isr[interrupt] = NULL;
+    s_isrpending[interrupt] = false;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Disable interrupts
+void noInterrupts()
+{
+  s_enabled = false;
+
+  Sim::Spend(Sim::CostInterrupts);
+}
+
+
+//---------------------------------------------------------------------------
+// Enable interrupts
+void interrupts()
+{
+  if (!s_inisr)
+  {
+    s_enabled = true;
+  }
+
+  Sim::Spend(Sim::CostInterrupts);
+}
+
+
+//---------------------------------------------------------------------------
+// Get a random number
+long random(
+  long howbig)
+{
+  return howbig ? rand() % howbig : 0;
+}
+
+
+//---------------------------------------------------------------------------
+// Get a random number in a range
+long random(
+  long howsmall,
+  long howbig)
+{
+  return (howsmall < howbig) ? howsmall + random(howbig - howsmall) : howsmall;
+}
+
+
+//---------------------------------------------------------------------------
+// Seed the random number generator
+void randomSeed(
+  unsigned long seed)
+{
+  srand((unsigned)seed);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SERIAL PORT
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Restore the file flags of stdin at exit
+//
+// The flags are shared with the shell if stdin is a terminal, so it would
+// be left in non-blocking mode otherwise.
+static void RestoreStdin()
+{
+  if (s_savedflags >= 0)
+  {
+    fcntl(0, F_SETFL, s_savedflags);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Constructor
+SimSerial::SimSerial(
+  int infd,                           // Input file descriptor
+  int outfd)                          // Output file descriptor
+  : m_infd(infd)
+  , m_outfd(outfd)
+  , m_baud(0)
+  , m_peek(-1)
+{
+  // Nothing to do here
+}
+
+
+//---------------------------------------------------------------------------
+// Start the serial port
+void
+SimSerial::begin(
+  unsigned long baud)                 // Baud rate (only stored)
+{
+  m_baud = baud;
+
+  // Don't let read wait for input
+  int flags = fcntl(m_infd, F_GETFL);
+
+  if ((m_infd == 0) && (s_savedflags < 0) && (flags >= 0))
+  {
+    s_savedflags = flags;
+    atexit(RestoreStdin);
+  }
+
+  fcntl(m_infd, F_SETFL, flags | O_NONBLOCK);
+}
+
+
+//---------------------------------------------------------------------------
+// Stop the serial port
+void
+SimSerial::end()
+{
+  m_baud = 0;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the number of bytes that can be read
+int                                   // Returns number of bytes
+SimSerial::available()
+{
+  return (peek() >= 0) ? 1 : 0;
+}
+
+
+//---------------------------------------------------------------------------
+// Read a byte
+int                                   // Returns byte or -1 if none
+SimSerial::read()
+{
+  int result = peek();
+
+  m_peek = -1;
+
+  return result;
+}
+
+
+//---------------------------------------------------------------------------
+// Look at the next byte without reading it
+int                                   // Returns byte or -1 if none
+SimSerial::peek()
+{
+  Sim::Spend(Sim::CostSerial);
+
+  if (m_peek < 0)
+  {
+    uint8_t c;
+
+    if (::read(m_infd, &c, 1) == 1)
+    {
+      m_peek = c;
+    }
+  }
+
+  return m_peek;
+}
+
+
+//---------------------------------------------------------------------------
+// Wait until all output is sent
+void
+SimSerial::flush()
+{
+  // Output is unbuffered
+}
+
+
+//---------------------------------------------------------------------------
+// Write bytes
+size_t                                // Returns number of bytes written
+SimSerial::write(
+  const uint8_t *buffer,              // Data to write
+  size_t size)                        // Number of bytes
+{
+  size_t done = 0;
+
+  Sim::Spend(Sim::CostSerial * size);
+
+  while (done < size)
+  {
+    ssize_t n = ::write(m_outfd, buffer + done, size - done);
+
+    if (n < 0)
+    {
+      if ((errno == EAGAIN) || (errno == EINTR))
+      {
+        continue;
+      }
+
+      break;
+    }
+
+    done += n;
+  }
+
+  return done;
+}
+
+
+//---------------------------------------------------------------------------
+// Print a signed number
+size_t                                // Returns number of bytes written
+SimSerial::print(
+  long n,                             // Number to print
+  int base)                           // Number base
+{
+  size_t result = 0;
+
+  if ((n < 0) && (base == DEC))
+  {
+    result = print('-');
+    n = -n;
+  }
+
+  return result + print((unsigned long)n, base);
+}
+
+
+//---------------------------------------------------------------------------
+// Print an unsigned number
+size_t                                // Returns number of bytes written
+SimSerial::print(
+  unsigned long n,                    // Number to print
+  int base)                           // Number base
+{
+  char buf[8 * sizeof(long) + 1];
+  char *p = &buf[sizeof(buf) - 1];
+
+  if (base < 2)
+  {
+    base = DEC;
+  }
+
+  *p = '\0';
+
+  do
+  {
+    unsigned digit = n % base;
+
+    n /= base;
+    *--p = (char)(digit < 10 ? '0' + digit : 'A' + digit - 10);
+  } while (n);
+
+  return write(p);
+}
+
+
+//---------------------------------------------------------------------------
+// Print a floating point number
+size_t                                // Returns number of bytes written
+SimSerial::print(
+  double n,                           // Number to print
+  int digits)                         // Digits after the decimal point
+{
+  char buf[40];
+
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+
+  return write(buf);
+}
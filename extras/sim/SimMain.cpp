@@ -0,0 +1,170 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  Main program for running a sketch in the host-side simulation.
+
+  This connects a simulated 30520 interface (or a chain of them) to the
+  simulated Arduino, and then calls setup() and loop() like the Arduino
+  core does. The interface is configured with environment variables,
+  because the sketch's global objects (such as a Fishduino object, which
+  resets the interface in its constructor) are constructed before main()
+  runs:
+
+  SIM_INTERFACES  Number of cascaded interfaces (default 1)
+  SIM_STARTPIN    First Arduino pin, as for Fishduino(startpin) (default 2)
+  SIM_INPUTS      Input bits per interface, e.g. "0x01,0x80" (default 0)
+  SIM_ANALOG      Analog times in us for X and Y, e.g. "500,2000"; 0 means
+                  no potentiometer (default 1000,1000)
+  SIM_RUNTIME     Simulated run time in ms; 0 runs forever (default 0)
+  SIM_STATS       If set to 1, print statistics to stderr at the end
+*/
+
+
+#include <stdio.h>
+
+#include "Sim30520.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get a number from an environment variable
+static unsigned long GetEnv(
+  const char *name,                   // Variable name
+  unsigned long defaultvalue)         // Value if not set
+{
+  const char *s = getenv(name);
+
+  return ((s) && (*s)) ? strtoul(s, NULL, 0) : defaultvalue;
+}
+
+
+//---------------------------------------------------------------------------
+// Get a comma-separated list of numbers from an environment variable
+static void GetEnvList(
+  const char *name,                   // Variable name
+  unsigned long *values,              // Values; unchanged if not in list
+  unsigned num)                       // Max number of values
+{
+  const char *s = getenv(name);
+
+  for (unsigned u = 0; (s) && (*s) && (u < num); u++)
+  {
+    char *end;
+
+    values[u] = strtoul(s, &end, 0);
+    s = (*end == ',') ? end + 1 : NULL;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Create and configure the simulated interface
+//
+// This is called only once, before the global objects of the sketch are
+// constructed.
+static Sim30520 &Interface()
+{
+  static Sim30520 iface(
+    (byte)GetEnv("SIM_STARTPIN", 2),
+    (byte)GetEnv("SIM_INTERFACES", 1));
+
+  unsigned long inputs[Sim30520::MaxInterfaces] = { 0 };
+  unsigned long analog[2] = { Sim30520::DefaultAnalog, Sim30520::DefaultAnalog };
+
+  GetEnvList("SIM_INPUTS", inputs, Sim30520::MaxInterfaces);
+  GetEnvList("SIM_ANALOG", analog, 2);
+
+  for (byte u = 0; u < Sim30520::MaxInterfaces; u++)
+  {
+    iface.SetInputs(u, (byte)inputs[u]);
+  }
+
+  iface.SetAnalog(0, (unsigned)analog[0]);
+  iface.SetAnalog(1, (unsigned)analog[1]);
+
+  return iface;
+}
+
+
+//---------------------------------------------------------------------------
+// Helper to create the interface before the sketch's objects
+static struct SimStart
+{
+  SimStart()
+  {
+    Interface();
+  }
+} s_start __attribute__((init_priority(101)));
+
+
+//---------------------------------------------------------------------------
+// Main program
+int main()
+{
+  unsigned long runtime = GetEnv("SIM_RUNTIME", 0);
+
+  setup();
+
+  while ((!runtime) || (Sim::Micros() / 1000 < runtime))
+  {
+    loop();
+
+    Sim::Spend(Sim::CostLoop);
+  }
+
+  if (GetEnv("SIM_STATS", 0))
+  {
+    Sim::Counters core = Sim::GetCounters();
+    Sim30520::Counters iface = Interface().GetCounters();
+
+    fprintf(stderr, "time_us=%lu cycles=%llu\n", Sim::Micros(), Sim::Cycles());
+    fprintf(stderr, "pinmodes=%lu pinwrites=%lu pinreads=%lu interrupts=%lu\n",
+      core.pinmodes, core.pinwrites, core.pinreads, core.interrupts);
+    fprintf(stderr, "clocks=%lu strobes=%lu loads=%lu triggers=%lu timeouts=%lu\n",
+      iface.clocks, iface.strobes, iface.loads, iface.triggers, iface.timeouts);
+
+    fprintf(stderr, "outputs=");
+
+    for (byte u = 0; u < GetEnv("SIM_INTERFACES", 1); u++)
+    {
+      fprintf(stderr, "%s0x%02X", u ? "," : "", Interface().GetOutputs(u));
+    }
+
+    fprintf(stderr, "\n");
+  }
+
+  return 0;
+}
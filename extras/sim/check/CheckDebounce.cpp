@@ -0,0 +1,135 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+/*
+  Check of the compatible debounce count of FishduinoMgr::UpdateInputs.
+
+  For each count n, an input is switched on and held, and UpdateInputs(n)
+  is called repeatedly; the manager must report the input after exactly
+  n + 1 calls, or after MaxDebounce calls if n is higher than that.
+  Calling UpdateInputs with the same count must not restart the debounce
+  counters, or the input would never get through. Calling it with count 0
+  afterwards must switch debouncing off again.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdio.h>
+
+#include "Sim30520.h"
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Check one debounce count
+bool                                    // Returns true=passed
+CheckCount(
+  Sim30520 &iface,                      // Simulated interface
+  FishduinoMgr &mgr,                    // Manager to check
+  unsigned count)                       // Debounce count for UpdateInputs
+{
+  // Let the input settle in the off state with this count first
+  iface.SetInputs(0, 0x00);
+
+  for (unsigned u = 0; u < 20; u++)
+  {
+    mgr.UpdateInputs(count);
+  }
+
+  iface.SetInputs(0, 0x01);
+
+  for (unsigned u = 1; u <= 20; u++)
+  {
+    mgr.UpdateInputs(count);
+
+    if (mgr.GetInputMask(0) & 0x01)
+    {
+      unsigned expected = (count < FishduinoMgr::MaxDebounce) ? count + 1 :
+        FishduinoMgr::MaxDebounce;
+
+      if (u != expected)
+      {
+        printf("FAIL: UpdateInputs(%u): input seen after %u calls\n", count, u);
+        return false;
+      }
+
+      printf("ok: UpdateInputs(%u): input seen after %u calls\n", count, u);
+      return true;
+    }
+  }
+
+  printf("FAIL: UpdateInputs(%u): input never seen\n", count);
+  return false;
+}
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  Sim30520 iface(2, 1);
+  FishduinoMgr mgr(2, 1);
+  bool passed = true;
+
+  for (unsigned count = 1; count < FishduinoMgr::MaxDebounce; count++)
+  {
+    if (!CheckCount(iface, mgr, count))
+    {
+      passed = false;
+    }
+  }
+
+  // Counts that are too high are limited, and 0 resets the threshold
+  if ((!CheckCount(iface, mgr, 255)) || (!CheckCount(iface, mgr, 1000)) ||
+    (!CheckCount(iface, mgr, 0)))
+  {
+    passed = false;
+  }
+
+  return passed ? 0 : 1;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
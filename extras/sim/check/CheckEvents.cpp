@@ -0,0 +1,161 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of the input event queue of FishduinoMgr.
+
+  Inputs on two interfaces are switched, and every change must come out
+  of the queue once, in order, with the right interface, pin, direction
+  and a time stamp that doesn't go backwards. A short pulse between two
+  calls of the main program must still give two events when the interface
+  is refreshed in the background. When the application doesn't get the
+  events, the queue must keep the oldest ones and count the lost ones.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Check the next event
+void
+CheckEvent(
+  FishduinoMgr &mgr,                    // Manager to check
+  byte intindex,                        // Expected interface index
+  byte pin,                             // Expected input pin
+  bool on,                              // Expected direction
+  unsigned long &time)                  // Time of previous event, updated
+{
+  FishduinoMgr::InputEvent event;
+
+  if (!Check(mgr.GetEvent(event), "event %u/%u %s in queue", intindex, pin,
+    on ? "on" : "off"))
+  {
+    return;
+  }
+
+  Check((event.intindex == intindex) && (event.pin == pin) &&
+    (event.on == on) && (event.time >= time), "event %u/%u %s: got "
+    "%u/%u %s at %luus", intindex, pin, on ? "on" : "off", event.intindex,
+    event.pin, event.on ? "on" : "off", event.time);
+
+  time = event.time;
+}
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  Sim30520 iface(2, 2);
+  FishduinoMgr mgr(2, 2);
+  FishduinoMgr::InputEvent event;
+  unsigned long time = 0;
+
+  mgr.Update();
+  mgr.FlushEvents();
+
+  // Two changes in one refresh, then one in the next
+  iface.SetInputs(0, 0x81);
+  iface.SetInputs(1, 0x04);
+  mgr.Update();
+  iface.SetInputs(0, 0x80);
+  mgr.Update();
+
+  CheckEvent(mgr, 0, 0, true, time);
+  CheckEvent(mgr, 0, 7, true, time);
+  CheckEvent(mgr, 1, 2, true, time);
+  CheckEvent(mgr, 0, 0, false, time);
+  Check(!mgr.GetEvent(event), "no more events");
+
+  // A pulse between two calls of the main program
+  mgr.SetBackground(true);
+  iface.SetInputs(1, 0x0C);
+  mgr.Tick();
+  iface.SetInputs(1, 0x04);
+  mgr.Tick();
+  mgr.UpdateInputs();
+
+  CheckEvent(mgr, 1, 3, true, time);
+  CheckEvent(mgr, 1, 3, false, time);
+  Check(!mgr.GetEvent(event), "no more events after pulse");
+  Check(!mgr.GetInputPin(1, 3), "pulse not in inputs");
+
+  mgr.SetBackground(false);
+
+  // Overflow: the first events are kept, the rest is counted
+  for (unsigned u = 0; u < FISHDUINO_EVENT_QUEUE_SIZE; u++)
+  {
+    iface.SetInputs(0, (u & 1) ? 0x80 : 0x90);
+    mgr.Update();
+  }
+
+  CheckEvent(mgr, 0, 4, true, time);
+  CheckEvent(mgr, 0, 4, false, time);
+
+  unsigned num = 2;
+
+  while (mgr.GetEvent(event))
+  {
+    num++;
+  }
+
+  Check((num == FISHDUINO_EVENT_QUEUE_SIZE - 1) &&
+    (mgr.GetEventsLost() == 1), "overflow: %u events, %u lost", num,
+    mgr.GetEventsLost());
+
+  mgr.FlushEvents();
+
+  Check(!mgr.GetEventsLost(), "lost events cleared by FlushEvents");
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
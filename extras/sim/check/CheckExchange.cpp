@@ -0,0 +1,148 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of Fishduino::Exchange, which shifts the outputs out and the inputs
+  in during the same clock pulses.
+
+  For 1 to 4 interfaces, the outputs must end up on the right interfaces
+  (the first byte on the interface that's connected to the Arduino), the
+  inputs must come back in the same order, and it must take one clock
+  pulse per bit plus one. That last pulse shifts the last input bit out,
+  so that DATA/COUNT IN is HIGH afterwards and the analog inputs can be
+  read. Without inputs, the input shift registers must not be loaded.
+  The same goes for the shift function of FishduinoFast.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "FishduinoFast.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Check one number of interfaces
+void
+CheckChain(
+  byte num,                             // Number of interfaces
+  bool fast)                            // True=use FishduinoFast pins
+{
+  Sim30520 iface(2, num);
+  Fishduino ft(2, num);
+  const char *name = fast ? "fast" : "normal";
+
+  if (fast)
+  {
+    Check(FishduinoFast<>::Attach(ft), "%s: attached", name);
+  }
+  byte out[Fishduino::MaxInterfaces] = { 0x12, 0x34, 0x56, 0x78 };
+  byte in[Fishduino::MaxInterfaces];
+  bool inputsok = true;
+  bool outputsok = true;
+
+  // Bit 0 of every input byte is on, so DATA/COUNT IN is LOW after the
+  // last bit unless it's shifted out
+  for (byte u = 0; u < num; u++)
+  {
+    iface.SetInputs(u, 0x81 + u * 0x11);
+  }
+
+  iface.ResetCounters();
+  ft.Exchange(out, in);
+
+  Sim30520::Counters counters = iface.GetCounters();
+
+  for (byte u = 0; u < num; u++)
+  {
+    outputsok &= (iface.GetOutputs(u) == out[u]);
+    inputsok &= (in[u] == 0x81 + u * 0x11);
+  }
+
+  Check(outputsok, "%s, %u interfaces: outputs in order", name, num);
+  Check(inputsok, "%s, %u interfaces: inputs in order", name, num);
+  Check((counters.clocks == 8u * num + 1) && (counters.loads == 1) &&
+    (counters.strobes == 1), "%s, %u interfaces: %lu clocks, %lu loads, "
+    "%lu latches", name, num, counters.clocks, counters.loads,
+    counters.strobes);
+  Check(Sim::PinLevel(2), "%s, %u interfaces: DATA/COUNT IN HIGH "
+    "afterwards", name, num);
+
+  // Without inputs, only the output bits are shifted
+  out[0] = 0x9A;
+  iface.ResetCounters();
+  ft.Exchange(out, NULL);
+  counters = iface.GetCounters();
+
+  Check((iface.GetOutputs(0) == 0x9A) && (counters.clocks == 8u * num) &&
+    (!counters.loads), "%s, %u interfaces: outputs only, %lu clocks, "
+    "%lu loads", name, num, counters.clocks, counters.loads);
+
+  // The same array can be used for outputs and inputs
+  memcpy(in, out, sizeof(in));
+  ft.Exchange(in, in);
+
+  Check((iface.GetOutputs(num - 1) == out[num - 1]) &&
+    (in[num - 1] == 0x81 + (num - 1) * 0x11),
+    "%s, %u interfaces: same array for outputs and inputs", name, num);
+}
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  for (byte num = 1; num <= Fishduino::MaxInterfaces; num++)
+  {
+    CheckChain(num, false);
+    CheckChain(num, true);
+  }
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,132 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of FishduinoOutGroup and FishduinoInGroup, groups of pins that
+  span several cascaded interfaces.
+
+  An output group must switch its pins on all interfaces at once and leave
+  the other outputs alone, and an input group must combine its pins of
+  all interfaces the way the documentation says. The same must work for
+  interfaces 4-7 (word 1) with a manager for 6 interfaces.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "FishduinoInGroup.h"
+#include "FishduinoOutGroup.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  {
+    Sim30520 iface(2, 3);
+    FishduinoMgr mgr(2, 3);
+    FishduinoOutGroup lamps(mgr,
+      FishduinoOutGroup::Bit(0, 0) | FishduinoOutGroup::Bit(2, 4));
+    FishduinoInGroup limits(mgr,
+      FishduinoInGroup::Bit(0, FishduinoInGroup::I1) |
+      FishduinoInGroup::Bit(2, FishduinoInGroup::I3));
+
+    mgr.SetOutputPin(1, 2);
+    lamps.Set(true);
+    mgr.Update();
+
+    Check((iface.GetOutputs(0) == 0x01) && (iface.GetOutputs(1) == 0x04) &&
+      (iface.GetOutputs(2) == 0x10), "output group on: %02X %02X %02X",
+      iface.GetOutputs(0), iface.GetOutputs(1), iface.GetOutputs(2));
+
+    lamps.Set(false);
+    mgr.Update();
+
+    Check((!iface.GetOutputs(0)) && (iface.GetOutputs(1) == 0x04) &&
+      (!iface.GetOutputs(2)), "output group off: %02X %02X %02X",
+      iface.GetOutputs(0), iface.GetOutputs(1), iface.GetOutputs(2));
+
+    Check(limits.IsOff() && !limits.Get(), "input group: all off");
+
+    // Inputs that aren't in the group don't count
+    iface.SetInputs(1, 0xFF);
+    iface.SetInputs(2, 0x04);
+    mgr.Update();
+
+    Check(limits.Get() && (!limits.Get(true)) && limits.Is(false, false) &&
+      (!limits.IsOn()) && (!limits.IsOff()), "input group: some on");
+
+    iface.SetInputs(0, 0x01);
+    mgr.Update();
+
+    Check(limits.IsOn() && limits.Get(true) && limits.Was(false, false),
+      "input group: all on, some on before");
+  }
+
+  {
+    Sim30520 iface(2, 6);
+    FishduinoMgrN<6> mgr(2);
+    FishduinoOutGroupT<FishduinoMgrN<6> > lamps(mgr,
+      FishduinoOutGroup::Bit(0, 7) | FishduinoOutGroup::Bit(1, 1), 1);
+    FishduinoInGroupT<FishduinoMgrN<6> > limits(mgr,
+      FishduinoInGroup::Bit(1, FishduinoInGroup::I8), 1);
+
+    lamps.Set(true);
+    iface.SetInputs(5, 0x80);
+    mgr.Update();
+
+    Check((iface.GetOutputs(4) == 0x80) && (iface.GetOutputs(5) == 0x02) &&
+      (!iface.GetOutputs(0)) && (!iface.GetOutputs(1)),
+      "word 1: output group on interfaces 4 and 5");
+    Check(limits.IsOn(), "word 1: input group on interface 5");
+  }
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,190 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of the interlock rules and tick handlers of FishduinoMgr.
+
+  Update and Tick read the inputs before they compose the outputs, so an
+  interlock must switch its outputs in the same call that first sees the
+  input, and a tick handler must see the inputs of the same refresh. A
+  latching rule must stay active until it's released, and the outputs
+  must come back when a rule isn't active anymore. With UpdateInputs and
+  UpdateOutputs, the rule must take effect at the next UpdateOutputs.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Tick handler that copies input I8 of interface 0 to output O8
+void
+CopyInput(
+  void *context)                        // Manager
+{
+  FishduinoMgr &mgr = *(FishduinoMgr *)context;
+
+  if (mgr.GetTickInputs(0) & 0x80)
+  {
+    mgr.SetTickOutputs(0, 0x80, 0);
+  }
+  else
+  {
+    mgr.SetTickOutputs(0, 0, 0x80);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Check the rules with one of the refresh functions
+void
+CheckRefresh(
+  Sim30520 &iface,                      // Simulated interface
+  FishduinoMgr &mgr,                    // Manager to check
+  bool background)                      // True=use Tick, false=Update
+{
+  const char *name = background ? "Tick" : "Update";
+
+  mgr.SetBackground(background);
+
+  iface.SetInputs(0, 0x01);
+  background ? mgr.Tick() : mgr.Update();
+
+  Check(iface.GetOutputs(1) == 0x0F, "%s: outputs on without rule", name);
+
+  // Non-latching rule: I3 of interface 0 switches M1 of interface 1 off
+  iface.SetInputs(0, 0x05);
+  background ? mgr.Tick() : mgr.Update();
+
+  Check(iface.GetOutputs(1) == 0x0C, "%s: rule active in same refresh",
+    name);
+
+  iface.SetInputs(0, 0x01);
+  background ? mgr.Tick() : mgr.Update();
+
+  Check(iface.GetOutputs(1) == 0x0F, "%s: outputs back in same refresh",
+    name);
+
+  // Latching rule: I1 of interface 0 off switches O3 of interface 0 on
+  // and M2 of interface 1 off
+  iface.SetInputs(0, 0x00);
+  background ? mgr.Tick() : mgr.Update();
+  iface.SetInputs(0, 0x01);
+  background ? mgr.Tick() : mgr.Update();
+
+  Check((iface.GetOutputs(0) & 0x04) && (iface.GetOutputs(1) == 0x03),
+    "%s: latching rule stays active", name);
+
+  mgr.ReleaseInterlocks();
+  background ? mgr.Tick() : mgr.Update();
+
+  Check((!(iface.GetOutputs(0) & 0x04)) && (iface.GetOutputs(1) == 0x0F),
+    "%s: latching rule released", name);
+
+  // The tick handler sees the inputs of the same refresh
+  iface.SetInputs(0, 0x81);
+  background ? mgr.Tick() : mgr.Update();
+
+  Check(iface.GetOutputs(0) & 0x80, "%s: tick handler reacts in same "
+    "refresh", name);
+
+  iface.SetInputs(0, 0x01);
+  background ? mgr.Tick() : mgr.Update();
+
+  Check(!(iface.GetOutputs(0) & 0x80), "%s: tick handler follows input",
+    name);
+
+  mgr.SetBackground(false);
+}
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  Sim30520 iface(2, 2);
+  FishduinoMgr mgr(2, 2);
+
+  // Every call is a tick
+  mgr.SetTickRate(0);
+
+  mgr.SetOutputMask(1, 0x0F, 0);
+
+  Check(mgr.AddInterlock(0, 0x04, 0x04, 1, 0x03) &&
+    mgr.AddInterlock(0, 0x01, 0x00, 0, 0, 0x04, true) &&
+    mgr.AddInterlock(0, 0x01, 0x00, 1, 0x0C, 0, true) &&
+    mgr.AddTickHandler(CopyInput, &mgr), "rules and tick handler added");
+
+  CheckRefresh(iface, mgr, false);
+  CheckRefresh(iface, mgr, true);
+
+  // UpdateOutputs doesn't read the inputs; the rule is applied with the
+  // inputs of the last UpdateInputs
+  iface.SetInputs(0, 0x05);
+  mgr.UpdateOutputs();
+
+  Check(iface.GetOutputs(1) == 0x0F, "UpdateOutputs: inputs not read");
+
+  mgr.UpdateInputs();
+  mgr.UpdateOutputs();
+
+  Check(iface.GetOutputs(1) == 0x0C, "UpdateOutputs: rule active after "
+    "UpdateInputs");
+
+  // Rules override the application
+  mgr.SetOutputMask(1, 0x03, 0x0C);
+  mgr.UpdateOutputs();
+
+  Check(!iface.GetOutputs(1), "rule overrides the application");
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,147 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of the keep-alive refreshes of FishduinoMgr::UpdateOutputs against
+  the watchdog of the simulated interface.
+
+  First, the check makes sure that the watchdog of the model turns the
+  outputs off when they're not refreshed for too long. Then the outputs
+  are set once and UpdateOutputs is called in a loop for a few seconds of
+  simulated time: most calls must be skipped, but the watchdog must never
+  time out. A change must be sent right away, and a slow loop (that calls
+  UpdateOutputs every 100ms) must keep the outputs alive too.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Call UpdateOutputs for some time
+void
+Run(
+  FishduinoMgr &mgr,                    // Manager to check
+  unsigned long ms,                     // Time to run (ms)
+  unsigned long interval)               // Time between calls (us)
+{
+  unsigned long start = Sim::Micros();
+
+  while (Sim::Micros() - start < ms * 1000)
+  {
+    mgr.UpdateOutputs();
+
+    // Simulated CPU runs at 16MHz
+    Sim::Spend(interval * 16);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  Sim30520 iface(2, 1);
+  FishduinoMgr mgr(2, 1);
+  FishduinoMgr::OutputStats stats;
+
+  // Without refreshes, the watchdog of the model turns the outputs off
+  mgr.SetOutputMask(0, 0x03, 0);
+  mgr.UpdateOutputs();
+  Sim::Spend(16000ul * (FishduinoMgr::WatchdogTimeout + 10));
+
+  Check(iface.IsTimedOut() && (iface.GetCounters().timeouts == 1),
+    "watchdog times out without refresh");
+
+  // A fast loop only sends keep-alive refreshes
+  mgr.UpdateOutputs(true);
+  iface.ResetCounters();
+  mgr.ResetOutputStats();
+
+  Run(mgr, 3000, 50);
+
+  mgr.GetOutputStats(stats);
+
+  Check((!iface.GetCounters().timeouts) && (iface.GetOutputs(0) == 0x03),
+    "fast loop: no timeouts in 3s");
+  Check((stats.keepalives >= 3000 / FishduinoMgr::DefaultKeepAlive) &&
+    (stats.keepalives <= 3000 / FishduinoMgr::DefaultKeepAlive + 1) &&
+    (!stats.changes), "fast loop: %lu keep-alive refreshes, %lu changes",
+    stats.keepalives, stats.changes);
+  Check(stats.skipped > 100 * stats.keepalives, "fast loop: %lu calls "
+    "skipped", stats.skipped);
+  Check(stats.worstmargin >= (long)FishduinoMgr::WatchdogTimeout -
+    FishduinoMgr::DefaultKeepAlive - 1, "fast loop: worst margin %ldms",
+    stats.worstmargin);
+
+  // A change is sent at the next call
+  mgr.SetOutputPin(0, 6, true);
+  mgr.UpdateOutputs();
+  mgr.GetOutputStats(stats);
+
+  Check((iface.GetOutputs(0) == 0x43) && (stats.changes == 1),
+    "change sent right away: %02x, %lu changes", iface.GetOutputs(0),
+    stats.changes);
+
+  // A slow loop still keeps the outputs alive
+  iface.ResetCounters();
+  mgr.ResetOutputStats();
+
+  Run(mgr, 3000, 100000ul);
+
+  mgr.GetOutputStats(stats);
+
+  Check((!iface.GetCounters().timeouts) && (stats.worstmargin > 0),
+    "slow loop: no timeouts, worst margin %ldms", stats.worstmargin);
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,228 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of FishduinoStepper and FishduinoServoAxis.
+
+  The stepper must switch its coils through the half-step pattern one step
+  at a time, in both directions, stop exactly on the target, leave the
+  other outputs alone and switch the coils off when it's released.
+
+  The servo axis drives a simple model of a motor with inertia and an
+  impulse switch. It must count every edge, and once it has learned how
+  far the motor coasts (during the first move), it must stop on every
+  target. It must report a stall and switch the motor off when the switch
+  stops changing.
+
+  Every call to the update functions is a tick here.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <math.h>
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "FishduinoStepper.h"
+#include "FishduinoServoAxis.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Move the stepper to a position and check the coils on the way
+void
+CheckStepper(
+  Sim30520 &iface,                      // Simulated interface
+  FishduinoMgr &mgr,                    // Manager to use
+  FishduinoStepper &stepper,            // Stepper on M1 and M2
+  long target)                          // Position to move to
+{
+  // Outputs of M1 and M2 for each position modulo 8
+  static const byte coils[8] =
+  {
+    0x02, 0x0A, 0x08, 0x09, 0x01, 0x05, 0x04, 0x06
+  };
+
+  long prev = stepper.GetPosition();
+  bool ok = true;
+  unsigned ticks = 0;
+
+  stepper.MoveTo(target);
+
+  while ((stepper.IsMoving()) && (ticks < 10000))
+  {
+    mgr.UpdateOutputs(true);
+    ticks++;
+
+    long pos = stepper.GetPosition();
+    byte out = iface.GetOutputs(0);
+
+    if (((out & 0x0F) != coils[pos & 7]) || (labs(pos - prev) > 1) ||
+      ((out & 0xF0) != 0x10))
+    {
+      printf("tick %u: position %ld, outputs %02X\n", ticks, pos, out);
+      ok = false;
+      break;
+    }
+
+    prev = pos;
+  }
+
+  Check(ok, "stepper to %ld: one half step at a time", target);
+  Check((!stepper.IsMoving()) && (stepper.GetPosition() == target),
+    "stepper to %ld: stopped at %ld after %u ticks", target,
+    stepper.GetPosition(), ticks);
+}
+
+
+//---------------------------------------------------------------------------
+// Run the motor model until the axis stops
+void
+RunAxis(
+  Sim30520 &iface,                      // Simulated interface
+  FishduinoMgr &mgr,                    // Manager to use
+  FishduinoServoAxis &axis,             // Axis on M1 with switch on I1
+  double &pos,                          // Motor position (edges)
+  double &speed,                        // Motor speed (edges per tick)
+  bool stuck)                           // True=motor doesn't move
+{
+  for (unsigned u = 0; (axis.IsMoving()) && (u < 20000); u++)
+  {
+    mgr.Update();
+
+    // The motor speeds up and slows down gradually
+    byte out = iface.GetOutputs(0) & 0x03;
+    double drive = (out == 0x02) ? 0.02 : (out == 0x01) ? -0.02 : 0;
+
+    speed += (drive - speed) * (drive ? 0.02 : 0.01);
+
+    if (!stuck)
+    {
+      pos += speed;
+    }
+
+    iface.SetInputs(0, ((long)floor(pos) & 1) ? 0x01 : 0x00);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  Sim30520 iface(2, 1);
+  FishduinoMgr mgr(2, 1);
+
+  mgr.SetTickRate(0);
+
+  // Stepper
+  {
+    FishduinoStepper stepper(mgr, 0, FishduinoStepper::M1,
+      FishduinoStepper::M2, true, 1000);
+
+    // An output that isn't used by the stepper
+    mgr.SetOutputPin(0, 4);
+
+    stepper.SetSpeed(500);
+    stepper.SetAcceleration(2000);
+    stepper.Begin();
+
+    CheckStepper(iface, mgr, stepper, 200);
+    CheckStepper(iface, mgr, stepper, -37);
+
+    stepper.Release();
+    mgr.UpdateOutputs(true);
+
+    Check(iface.GetOutputs(0) == 0x10, "stepper released: outputs %02X",
+      iface.GetOutputs(0));
+
+    stepper.End();
+    mgr.SetOutputPin(0, 4, false);
+  }
+
+  // Servo axis
+  {
+    FishduinoServoAxis axis(mgr, 0, FishduinoServoAxis::M1,
+      FishduinoServoAxis::I1);
+    static const long targets[] = { 20, 40, 100, 60, 0, 30 };
+    double pos = 0.5;
+    double speed = 0;
+
+    axis.Begin();
+
+    // The first move may end an edge off, while the axis learns
+    axis.MoveTo(10);
+    RunAxis(iface, mgr, axis, pos, speed, false);
+
+    Check(fabs(pos - 0.5 - axis.GetPosition()) < 1.0, "axis to 10: "
+      "position %ld, motor at %.2f", axis.GetPosition(), pos - 0.5);
+
+    for (byte u = 0; u < sizeof(targets) / sizeof(targets[0]); u++)
+    {
+      axis.MoveTo(targets[u]);
+      RunAxis(iface, mgr, axis, pos, speed, false);
+
+      Check((axis.GetPosition() == targets[u]) &&
+        (fabs(pos - 0.5 - targets[u]) < 1.0), "axis to %ld: position %ld, "
+        "motor at %.2f", targets[u], axis.GetPosition(), pos - 0.5);
+    }
+
+    // Let the motor come to a standstill, then block it
+    RunAxis(iface, mgr, axis, pos, speed, false);
+    axis.SetStallTimeout(200);
+    axis.MoveTo(50);
+    RunAxis(iface, mgr, axis, pos, speed, true);
+
+    Check((axis.IsStalled()) && (!(iface.GetOutputs(0) & 0x03)),
+      "axis stalled: motor off");
+
+    axis.End();
+  }
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
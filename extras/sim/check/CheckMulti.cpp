@@ -0,0 +1,149 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of FishduinoMulti, which drives several chains of interfaces.
+
+  Two chains share the CLOCK, LOAD OUT and LOAD IN pins, so they must be
+  shifted in lockstep: one series of clock pulses (for the longest chain,
+  plus one) and one output latch pulse must refresh both chains, with the
+  outputs and inputs of each chain in the right order. A NULL entry must
+  clear the outputs of one chain, and chains that don't share their pins
+  must still be refreshed, one after the other.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "FishduinoMulti.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  //                DCI TX  TY  DO CLK LO  LI
+  Sim30520  leftiface(2,  9, 10, 4, 6,  7,  8, 2);
+  Sim30520 rightiface(3, 11, 12, 5, 6,  7,  8, 1);
+  Sim30520 otheriface(20, 21, 22, 23, 24, 25, 26, 1);
+
+  Fishduino left(2, 9, 10, 4, 6, 7, 8, 2);
+  Fishduino right(3, 11, 12, 5, 6, 7, 8, 1);
+  Fishduino other(20, 21, 22, 23, 24, 25, 26, 1);
+
+  {
+    FishduinoMulti multi;
+
+    multi.AddChain(left);
+    multi.AddChain(right);
+
+    Check(multi.Reset() && multi.IsLockstep(), "shared pins: lockstep");
+
+    leftiface.SetInputs(0, 0x81);
+    leftiface.SetInputs(1, 0x42);
+    rightiface.SetInputs(0, 0x24);
+
+    byte leftout[2] = { 0x11, 0x22 };
+    byte rightout[1] = { 0x33 };
+    byte leftin[2];
+    byte rightin[1];
+    const byte *out[] = { leftout, rightout };
+    byte *in[] = { leftin, rightin };
+
+    leftiface.ResetCounters();
+    rightiface.ResetCounters();
+    multi.Exchange(out, in);
+
+    Sim30520::Counters counters = leftiface.GetCounters();
+
+    Check((leftiface.GetOutputs(0) == 0x11) &&
+      (leftiface.GetOutputs(1) == 0x22) && (rightiface.GetOutputs(0) == 0x33),
+      "lockstep: outputs of both chains");
+    Check((leftin[0] == 0x81) && (leftin[1] == 0x42) && (rightin[0] == 0x24),
+      "lockstep: inputs of both chains");
+    Check((counters.clocks == 17) && (counters.strobes == 1) &&
+      (counters.loads == 1), "lockstep: %lu clocks, %lu latches, %lu loads",
+      counters.clocks, counters.strobes, counters.loads);
+
+    // A NULL entry clears the outputs of one chain
+    out[0] = NULL;
+    multi.Exchange(out, NULL);
+
+    Check((!leftiface.GetOutputs(0)) && (!leftiface.GetOutputs(1)) &&
+      (rightiface.GetOutputs(0) == 0x33), "lockstep: NULL clears one chain");
+  }
+
+  {
+    FishduinoMulti multi;
+
+    multi.AddChain(left);
+    multi.AddChain(other);
+
+    Check(multi.Reset() && !multi.IsLockstep(), "separate pins: no lockstep");
+
+    otheriface.SetInputs(0, 0x18);
+
+    byte leftout[2] = { 0x44, 0x55 };
+    byte otherout[1] = { 0x66 };
+    byte leftin[2];
+    byte otherin[1];
+    const byte *out[] = { leftout, otherout };
+    byte *in[] = { leftin, otherin };
+
+    multi.Exchange(out, in);
+
+    Check((leftiface.GetOutputs(0) == 0x44) &&
+      (leftiface.GetOutputs(1) == 0x55) && (otheriface.GetOutputs(0) == 0x66)
+      && (leftin[1] == 0x42) && (otherin[0] == 0x18),
+      "separate pins: both chains refreshed");
+  }
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
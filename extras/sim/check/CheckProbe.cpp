@@ -0,0 +1,126 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of Fishduino::Probe, which finds out how many interfaces are
+  connected.
+
+  Three interfaces are simulated, and the Fishduino object is configured
+  for one. The probe must find the last interface that has an input on,
+  without changing any outputs, and it must only change the number of
+  interfaces when asked to, and only to increase it.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "Fishduino.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the number of interfaces that GetInputs reads
+byte                                    // Returns number of interfaces
+CountRead(
+  Fishduino &ft)                        // Object to check
+{
+  byte in[Fishduino::MaxInterfaces];
+  byte result = 0;
+
+  memset(in, 0xEE, sizeof(in));
+  ft.GetInputs(in);
+
+  while ((result < Fishduino::MaxInterfaces) && (in[result] != 0xEE))
+  {
+    result++;
+  }
+
+  return result;
+}
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  Sim30520 iface(2, 3);
+  Fishduino ft(2, 1);
+  byte out[1] = { 0x5A };
+
+  ft.SetOutputs(out);
+
+  iface.SetInputs(1, 0x10);
+  iface.ResetCounters();
+
+  byte result = ft.Probe();
+
+  Check(result == 2, "input on interface 1: probe found %u", result);
+  Check((!iface.GetCounters().strobes) && (iface.GetOutputs(0) == 0x5A),
+    "outputs not changed by probe");
+  Check(CountRead(ft) == 1, "number of interfaces not changed");
+
+  iface.SetInputs(2, 0x01);
+  result = ft.Probe();
+
+  Check(result == 3, "input on interface 2: probe found %u", result);
+
+  ft.Probe(true);
+
+  Check(CountRead(ft) == 3, "number of interfaces increased to %u",
+    CountRead(ft));
+
+  iface.SetInputs(1, 0);
+  iface.SetInputs(2, 0);
+  result = ft.Probe(true);
+
+  Check(result == 0, "no inputs on: probe found %u", result);
+  Check(CountRead(ft) == 3, "number of interfaces not decreased");
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
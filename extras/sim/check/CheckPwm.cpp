@@ -0,0 +1,214 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of the software PWM of FishduinoMgr.
+
+  For a number of duty cycles, an output is refreshed for one PWM period,
+  and it must be on for the number of ticks that the duty cycle scales to.
+  The other outputs of the interface must not be affected: PWM is only
+  applied to the outputs that have a duty cycle. A motor that's started at
+  half speed must only pulse the output for its direction. Finally, the
+  PWM counter must advance at the tick rate, not at every call to
+  UpdateOutputs.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "FishduinoMotor.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Number of ticks counted by CountTick
+static unsigned s_ticks;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Tick handler that counts the ticks
+void
+CountTick(
+  void *context)                        // Not used
+{
+  (void)context;
+
+  s_ticks++;
+}
+
+
+//---------------------------------------------------------------------------
+// Count the ticks in one PWM period during which outputs were on
+//
+// Returns the number of ticks during which all outputs of the mask were
+// on; if any other output was seen in the wrong state, returns 0xFF.
+byte                                    // Returns ticks on, 0xFF=error
+CountOn(
+  Sim30520 &iface,                      // Simulated interface
+  FishduinoMgr &mgr,                    // Manager to check
+  byte mask,                            // Outputs with PWM
+  byte others)                          // State of other outputs
+{
+  byte result = 0;
+
+  for (byte u = 0; u < FishduinoMgr::PwmLevels; u++)
+  {
+    mgr.UpdateOutputs(true);
+
+    byte out = iface.GetOutputs(0);
+
+    if ((out & ~mask) != others)
+    {
+      return 0xFF;
+    }
+
+    if ((out & mask) == mask)
+    {
+      result++;
+    }
+  }
+
+  return result;
+}
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  Sim30520 iface(2, 1);
+  FishduinoMgr mgr(2, 1);
+  static const byte duties[] = { 0, 1, 64, 128, 192, 254, 255 };
+
+  // Every call is a tick
+  mgr.SetTickRate(0);
+
+  // Outputs without PWM, that must stay as they are
+  mgr.SetOutputMask(0, 0x20, 0x40);
+
+  for (byte d = 0; d < sizeof(duties); d++)
+  {
+    byte duty = duties[d];
+    byte expected = ((unsigned)duty * FishduinoMgr::PwmLevels + 128) >> 8;
+
+    if (duty == 255)
+    {
+      expected = FishduinoMgr::PwmLevels;
+    }
+    else if (duty)
+    {
+      expected = constrain(expected, 1, FishduinoMgr::PwmLevels - 1);
+    }
+
+    mgr.SetOutputDuty(0, 0x03, duty);
+
+    byte on = CountOn(iface, mgr, 0x03, 0x20);
+
+    Check(on == expected, "duty %u: on for %u of %u ticks", duty, on,
+      FishduinoMgr::PwmLevels);
+  }
+
+  // Setting the outputs turns PWM off
+  mgr.SetOutputDuty(0, 0x03, 128);
+  mgr.SetOutputPin(0, 0, true);
+  mgr.SetOutputPin(0, 1, false);
+
+  byte on = CountOn(iface, mgr, 0x01, 0x20);
+
+  Check(on == FishduinoMgr::PwmLevels, "SetOutputPin turns PWM off");
+
+  // A motor at half speed only pulses the output for its direction
+  FishduinoMotor motor(mgr, 0, FishduinoMotor::M3);
+
+  mgr.SetOutputMask(0, 0, 0x03);
+  motor.Rotate(FishduinoMotor::CW, 128);
+  on = CountOn(iface, mgr, 0x20, 0x00);
+
+  Check(on == FishduinoMgr::PwmLevels / 2, "motor at half speed: on for "
+    "%u of %u ticks", on, FishduinoMgr::PwmLevels);
+
+  // At 1000 ticks per second, a PWM period takes PwmLevels milliseconds,
+  // no matter how often UpdateOutputs is called
+  mgr.AddTickHandler(CountTick, NULL);
+  mgr.SetTickRate(1000);
+
+  unsigned long start = Sim::Micros();
+  unsigned calls = 0;
+  byte pulses = 0;
+  byte prev = iface.GetOutputs(0);
+
+  s_ticks = 0;
+
+  while (Sim::Micros() - start < 4000ul * FishduinoMgr::PwmLevels)
+  {
+    mgr.UpdateOutputs();
+    calls++;
+
+    byte out = iface.GetOutputs(0);
+
+    if ((out & ~prev) & 0x20)
+    {
+      pulses++;
+    }
+
+    prev = out;
+  }
+
+  Check((s_ticks >= 4u * FishduinoMgr::PwmLevels - 1) &&
+    (s_ticks <= 4u * FishduinoMgr::PwmLevels + 1) && (calls > s_ticks),
+    "tick rate 1000: %u ticks in %u calls", s_ticks, calls);
+  Check((pulses >= 3) && (pulses <= 5), "tick rate 1000: %u PWM pulses in "
+    "4 periods", pulses);
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,181 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of the output sequences of FishduinoMgr.
+
+  A sequence of two steps is played twice, followed by a chained
+  sequence, with every call to UpdateOutputs being a tick. The outputs
+  must follow the steps tick by tick, the outputs that the sequence
+  doesn't control must keep the state that the application gave them, and
+  afterwards all outputs must go back to that state. A sequence that
+  repeats forever must keep playing, and PlaySequence(NULL) must stop it.
+  At 1000 ticks per second, a step must last its number of milliseconds
+  (give or take the time until the first tick), no matter how often
+  UpdateOutputs is called.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "Check.h"
+#include "Sim30520.h"
+#include "FishduinoMgr.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Sequence that's played twice
+const FishduinoMgr::Step s_first[] PROGMEM =
+{
+  { { 0x01 }, 2 },
+  { { 0x02 }, 1 },
+  { { 0 }, 0 }
+};
+
+// Sequence that's chained to it
+const FishduinoMgr::Step s_second[] PROGMEM =
+{
+  { { 0x80 }, 3 },
+  { { 0 }, 0 }
+};
+
+// Sequence with long steps for checking the timing
+const FishduinoMgr::Step s_slow[] PROGMEM =
+{
+  { { 0x01 }, 10 },
+  { { 0x02 }, 10 },
+  { { 0 }, 0 }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  Sim30520 iface(2, 1);
+  FishduinoMgr mgr(2, 1);
+
+  // Every call is a tick
+  mgr.SetTickRate(0);
+
+  // Output 6 isn't controlled by the sequence, output 0 is
+  mgr.SetSequenceMask(0, 0x8F);
+  mgr.SetOutputMask(0, 0x41, 0);
+
+  static const byte expected[] =
+  {
+    0x41, 0x41, 0x42, 0x41, 0x41, 0x42, 0xC0, 0xC0, 0xC0, 0x41, 0x41
+  };
+
+  mgr.PlaySequence(s_first, 2);
+  mgr.ChainSequence(s_second);
+
+  bool ok = true;
+
+  for (byte u = 0; u < sizeof(expected); u++)
+  {
+    mgr.UpdateOutputs(true);
+
+    if (iface.GetOutputs(0) != expected[u])
+    {
+      printf("tick %u: outputs %02X, expected %02X\n", u,
+        iface.GetOutputs(0), expected[u]);
+      ok = false;
+    }
+  }
+
+  Check(ok, "steps, repeats and chained sequence");
+  Check(!mgr.IsSequencePlaying(), "sequence done");
+
+  // Forever until stopped
+  mgr.PlaySequence(s_first, 0);
+
+  for (unsigned u = 0; u < 100; u++)
+  {
+    mgr.UpdateOutputs(true);
+  }
+
+  Check(mgr.IsSequencePlaying(), "sequence repeats forever");
+
+  mgr.PlaySequence(NULL);
+  mgr.UpdateOutputs(true);
+
+  Check((!mgr.IsSequencePlaying()) && (iface.GetOutputs(0) == 0x41),
+    "PlaySequence(NULL) stops the sequence");
+
+  // At 1000 ticks per second, the first step lasts about 10ms; the
+  // sequence starts right away, but the first tick may be up to 1ms later
+  mgr.SetTickRate(1000);
+  mgr.PlaySequence(s_slow, 1);
+
+  unsigned long start = Sim::Micros();
+  unsigned long changed = 0;
+
+  while ((mgr.IsSequencePlaying()) && (Sim::Micros() - start < 100000ul))
+  {
+    mgr.UpdateOutputs();
+
+    if ((!changed) && (iface.GetOutputs(0) & 0x02))
+    {
+      changed = Sim::Micros() - start;
+    }
+  }
+
+  unsigned long total = Sim::Micros() - start;
+
+  Check((changed >= 10000) && (changed <= 12000), "tick rate 1000: first "
+    "step took %luus", changed);
+  Check((total >= 20000) && (total <= 22000), "tick rate 1000: sequence "
+    "took %luus", total);
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
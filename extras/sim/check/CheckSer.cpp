@@ -0,0 +1,513 @@
+/****************************************************************************
+Copyright (c) 2015, Jac Goudsmit
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+* Neither the name of the {organization} nor the names of its
+contributors may be used to endorse or promote products derived from
+this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+****************************************************************************/
+
+
+
+/*
+  Check of the extended protocol of the Fishduino_Ser sketch.
+
+  The sketch is converted with ino2cpp.sh and linked into this program
+  (see runchecks.sh); this program takes the place of SimMain.cpp. Bytes
+  for the sketch are written to a pipe that replaces stdin, and the replies
+  are collected from a pipe that replaces stdout while the sketch runs.
+
+  The checks cover the legacy command that comes first, the switch to the
+  extended protocol, exchange frames with and without analog inputs,
+  several frames sent without waiting, rejection of corrupted, unknown,
+  wrongly sized and incomplete frames (with one NAK per bad frame and
+  resynchronization at the next good one), subscriptions with change
+  records and keep-alive refreshes, and going back to the legacy protocol
+  on request and when the host goes away.
+
+  Returns 0 if all checks pass. See the README of the simulation.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Check.h"
+#include "Sim30520.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Frame received from the sketch
+struct Frame
+{
+  byte              seq;                // Sequence number
+  byte              cmd;                // Command
+  byte              len;                // Payload length
+  byte              payload[16];        // Payload
+};
+
+
+// Constants of the protocol, see fishduino_protocol.txt
+enum
+{
+  Sync = 0xA5,
+  CmdExchange = 0x01,
+  CmdSubscribe = 0x02,
+  CmdInputs = 0x03,
+  CmdLeave = 0x0F,
+  CmdNak = 0x7F,
+  ErrCrc = 1,
+  ErrCommand,
+  ErrLength,
+  ErrTimeout,
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+static int          s_tosketch;         // Write end of the sketch's stdin
+static int          s_fromsketch;       // Read end of the sketch's stdout
+static int          s_sketchout;        // Write end of the sketch's stdout
+static int          s_stdout;           // Our own stdout
+static byte         s_reply[1024];      // Bytes received from sketch
+static unsigned     s_replylen;         // Number of bytes in s_reply
+static unsigned     s_replypos;         // Number of bytes used
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SKETCH
+/////////////////////////////////////////////////////////////////////////////
+
+
+void setup();
+void loop();
+
+
+//---------------------------------------------------------------------------
+// Get the simulated interfaces
+//
+// The interface has to exist before the Fishduino object of the sketch is
+// constructed, see SimMain.cpp.
+static Sim30520 &Interface()
+{
+  static Sim30520 iface(2, 2);
+
+  return iface;
+}
+
+
+//---------------------------------------------------------------------------
+// Helper to create the interface before the sketch's objects
+static struct SimStart
+{
+  SimStart()
+  {
+    Interface();
+  }
+} s_start __attribute__((init_priority(101)));
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CODE
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Calculate a CRC-16/CCITT-FALSE
+word
+Crc16(
+  const byte *data,                     // Data
+  unsigned len)                         // Number of bytes
+{
+  word crc = 0xFFFF;
+
+  while (len--)
+  {
+    crc ^= (word)*data++ << 8;
+
+    for (byte u = 0; u < 8; u++)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+
+//---------------------------------------------------------------------------
+// Send bytes to the sketch
+void
+Send(
+  const byte *data,                     // Bytes to send
+  unsigned len)                         // Number of bytes
+{
+  if (write(s_tosketch, data, len) != (ssize_t)len)
+  {
+    perror("write");
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Build a frame
+unsigned                                // Returns frame size
+BuildFrame(
+  byte *buf,                            // Receives frame
+  byte seq,                             // Sequence number
+  byte cmd,                             // Command
+  const byte *payload,                  // Payload
+  byte len)                             // Payload length
+{
+  buf[0] = Sync;
+  buf[1] = seq;
+  buf[2] = cmd;
+  buf[3] = len;
+  memcpy(buf + 4, payload, len);
+
+  word crc = Crc16(buf, 4 + len);
+
+  buf[4 + len] = (byte)(crc >> 8);
+  buf[5 + len] = (byte)crc;
+
+  return 6 + len;
+}
+
+
+//---------------------------------------------------------------------------
+// Send a frame to the sketch
+void
+SendFrame(
+  byte seq,                             // Sequence number
+  byte cmd,                             // Command
+  const byte *payload,                  // Payload
+  byte len)                             // Payload length
+{
+  byte buf[32];
+
+  Send(buf, BuildFrame(buf, seq, cmd, payload, len));
+}
+
+
+//---------------------------------------------------------------------------
+// Run the sketch for some simulated time and collect what it sends
+void
+Run(
+  unsigned long ms)                     // Time to run (ms)
+{
+  unsigned long start = Sim::Micros();
+
+  fflush(stdout);
+  dup2(s_sketchout, 1);
+
+  while (Sim::Micros() - start < ms * 1000)
+  {
+    loop();
+
+    Sim::Spend(Sim::CostLoop);
+  }
+
+  dup2(s_stdout, 1);
+
+  ssize_t n;
+
+  while ((s_replylen < sizeof(s_reply)) &&
+    ((n = read(s_fromsketch, s_reply + s_replylen,
+    sizeof(s_reply) - s_replylen)) > 0))
+  {
+    s_replylen += n;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the number of reply bytes that weren't used yet
+unsigned                                // Returns number of bytes
+Pending()
+{
+  return s_replylen - s_replypos;
+}
+
+
+//---------------------------------------------------------------------------
+// Check the next reply bytes
+bool                                    // Returns true=match
+Expect(
+  const byte *data,                     // Expected bytes
+  unsigned len)                         // Number of bytes
+{
+  if ((Pending() < len) || (memcmp(s_reply + s_replypos, data, len)))
+  {
+    return false;
+  }
+
+  s_replypos += len;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the next reply frame
+bool                                    // Returns true=valid frame
+GetFrame(
+  Frame &frame)                         // Receives frame
+{
+  const byte *p = s_reply + s_replypos;
+
+  if ((Pending() < 6) || (p[0] != Sync) || (p[3] > sizeof(frame.payload)) ||
+    (Pending() < 6u + p[3]))
+  {
+    return false;
+  }
+
+  unsigned size = 6 + p[3];
+
+  if (Crc16(p, size - 2) != (((word)p[size - 2] << 8) | p[size - 1]))
+  {
+    return false;
+  }
+
+  frame.seq = p[1];
+  frame.cmd = p[2];
+  frame.len = p[3];
+  memcpy(frame.payload, p + 4, frame.len);
+
+  s_replypos += size;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Check that the next reply is the given frame
+bool                                    // Returns true=match
+ExpectFrame(
+  byte seq,                             // Expected sequence number
+  byte cmd,                             // Expected command
+  const byte *payload,                  // Expected payload
+  byte len)                             // Expected payload length
+{
+  Frame frame;
+
+  return (GetFrame(frame)) && (frame.seq == seq) && (frame.cmd == cmd) &&
+    (frame.len == len) && (!memcmp(frame.payload, payload, len));
+}
+
+
+//---------------------------------------------------------------------------
+// Check that the next reply is a NAK
+bool                                    // Returns true=match
+ExpectNak(
+  byte seq,                             // Expected sequence number
+  byte error)                           // Expected error code
+{
+  return ExpectFrame(seq, CmdNak, &error, 1);
+}
+
+
+//---------------------------------------------------------------------------
+// Main function
+int
+main()
+{
+  Sim30520 &iface = Interface();
+  int topipe[2];
+  int frompipe[2];
+
+  if ((pipe(topipe)) || (pipe(frompipe)))
+  {
+    perror("pipe");
+    return 1;
+  }
+
+  // The sketch reads from stdin, and writes to stdout while it runs
+  dup2(topipe[0], 0);
+  s_tosketch = topipe[1];
+  s_fromsketch = frompipe[0];
+  s_sketchout = frompipe[1];
+  s_stdout = dup(1);
+  fcntl(s_fromsketch, F_SETFL, O_NONBLOCK);
+
+  static const byte check[] = "123456789";
+
+  Check(Crc16(check, 9) == 0x29B1, "CRC of check string");
+
+  iface.SetInputs(0, 0x81);
+  iface.SetInputs(1, 0x42);
+  iface.SetAnalog(0, 700);
+  iface.SetAnalog(1, 1500);
+
+  setup();
+
+  // The extended protocol can only be requested after a legacy command
+  static const byte early[] = { 0xE1, 0x07 };
+  static const byte legacy[] = { 0xC2, 0x05, 0x0A };
+  static const byte legacyreply[] = { 0x81, 0x42 };
+
+  Send(early, sizeof(early));
+  Send(legacy, sizeof(legacy));
+  Run(50);
+
+  Check(Expect(legacyreply, sizeof(legacyreply)) && (!Pending()) &&
+    (iface.GetOutputs(0) == 0x05) && (iface.GetOutputs(1) == 0x0A),
+    "legacy command, early request ignored");
+
+  // Switch to 1Mbaud
+  static const byte request[] = { 0xE1, 0x07 };
+
+  Send(request, sizeof(request));
+  Run(10);
+
+  Check(Expect(request, sizeof(request)) && (Serial.baud() == 1000000),
+    "switched to extended protocol at %lu baud", Serial.baud());
+
+  // Garbage before a frame is skipped
+  static const byte garbage[] = { 0x12, 0x34 };
+  static const byte exchange[] = { 0x00, 0x11, 0x22 };
+
+  Send(garbage, sizeof(garbage));
+  SendFrame(1, CmdExchange, exchange, sizeof(exchange));
+  Run(10);
+
+  Check(ExpectFrame(1, CmdExchange, legacyreply, sizeof(legacyreply)) &&
+    (iface.GetOutputs(0) == 0x11) && (iface.GetOutputs(1) == 0x22),
+    "exchange frame");
+
+  // Analog inputs
+  static const byte analog[] = { 0x03, 0x33 };
+  Frame frame;
+
+  SendFrame(2, CmdExchange, analog, sizeof(analog));
+  Run(20);
+
+  Check(GetFrame(frame) && (frame.seq == 2) && (frame.len == 5) &&
+    (frame.payload[0] == 0x81) &&
+    (abs(((frame.payload[1] << 8) | frame.payload[2]) - 700) < 50) &&
+    (abs(((frame.payload[3] << 8) | frame.payload[4]) - 1500) < 100),
+    "exchange frame with analog inputs");
+
+  // Several frames at once, with a corrupted frame and a lost byte; each
+  // bad frame gets one NAK, and the good frames after it are executed
+  byte buf[128];
+  unsigned len = 0;
+
+  len += BuildFrame(buf + len, 3, CmdExchange, exchange, sizeof(exchange));
+  buf[len - 3] ^= 0x01;
+  len += BuildFrame(buf + len, 4, CmdExchange, exchange, sizeof(exchange));
+  len += BuildFrame(buf + len, 5, CmdExchange, exchange, sizeof(exchange));
+  memmove(buf + len - 4, buf + len - 3, 3);
+  len--;
+  len += BuildFrame(buf + len, 6, CmdExchange, exchange, sizeof(exchange));
+
+  Send(buf, len);
+  Run(10);
+
+  Check(ExpectNak(3, ErrCrc), "corrupted frame: NAK");
+  Check(ExpectFrame(4, CmdExchange, legacyreply, sizeof(legacyreply)),
+    "frame after corrupted frame");
+  Check(ExpectNak(5, ErrCrc), "frame with lost byte: NAK");
+  Check(ExpectFrame(6, CmdExchange, legacyreply, sizeof(legacyreply)) &&
+    (!Pending()), "frame after lost byte, no more replies");
+
+  // Unknown command, wrong length, incomplete frame
+  SendFrame(7, 0x09, NULL, 0);
+  SendFrame(8, CmdExchange, exchange, 1);
+  len = BuildFrame(buf, 9, CmdExchange, exchange, sizeof(exchange));
+  Send(buf, len - 2);
+  Run(50);
+
+  Check(ExpectNak(7, ErrCommand), "unknown command: NAK");
+  Check(ExpectNak(8, ErrLength), "wrong length: NAK");
+  Check(ExpectNak(9, ErrTimeout) && (!Pending()), "incomplete frame: NAK");
+
+  // Subscription: the inputs are sent when they change, and the outputs
+  // are kept alive without frames from the host
+  static const byte subscribe[] = { 2, 10 };
+  static const byte changed[] = { 0x01, 0x42 };
+
+  SendFrame(10, CmdSubscribe, subscribe, sizeof(subscribe));
+  Run(20);
+
+  Check(ExpectFrame(10, CmdSubscribe, legacyreply, sizeof(legacyreply)) &&
+    (!Pending()), "subscribed");
+
+  iface.ResetCounters();
+  iface.SetInputs(0, 0x01);
+  Run(1000);
+
+  Check(ExpectFrame(0, CmdInputs, changed, sizeof(changed)) && (!Pending()),
+    "one change record");
+  Check((!iface.GetCounters().timeouts) && (iface.GetOutputs(0) == 0x11),
+    "outputs kept alive");
+
+  // Back to the legacy protocol; the subscription stops
+  SendFrame(11, CmdLeave, NULL, 0);
+  Run(20);
+
+  Check(ExpectFrame(11, CmdLeave, NULL, 0) && (Serial.baud() == 9600) &&
+    (!iface.GetOutputs(0)), "left extended protocol");
+
+  static const byte legacy1[] = { 0xC1, 0x00 };
+  static const byte legacy1reply[] = { 0x01 };
+
+  Send(legacy1, sizeof(legacy1));
+  Run(20);
+
+  Check(Expect(legacy1reply, sizeof(legacy1reply)) && (!Pending()),
+    "legacy command after leaving");
+
+  // If the host goes away, the sketch goes back to the legacy protocol
+  static const byte request2[] = { 0xE1, 0x04 };
+
+  Send(request2, sizeof(request2));
+  Run(10);
+
+  Check(Expect(request2, sizeof(request2)) && (Serial.baud() == 115200),
+    "switched to %lu baud", Serial.baud());
+
+  Run(2100);
+
+  Check((Serial.baud() == 9600) && (!Pending()),
+    "back to legacy protocol after timeout");
+
+  return CheckResult();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
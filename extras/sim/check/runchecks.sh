@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# Build and run all check programs in this directory, and report the ones
+# that failed. The programs are linked with the library and the host-side
+# simulation; CheckSer is also linked with the Fishduino_Ser sketch (see
+# ino2cpp.sh), and takes the place of SimMain.cpp.
+#
+# Usage: runchecks.sh [builddir]
+#
+# The programs are built in the given directory, or in a temporary
+# directory that's removed afterwards. Set CXX to use another compiler.
+# The exit code is 0 if all checks passed.
+
+check=$(cd "$(dirname "$0")" && pwd)
+sim=$(dirname "$check")
+root=$(cd "$sim/../.." && pwd)
+
+if [ $# -gt 1 ]; then
+  echo "Usage: $0 [builddir]" >&2
+  exit 2
+fi
+
+if [ $# -eq 1 ]; then
+  out=$1
+  mkdir -p "$out" || exit 2
+else
+  out=$(mktemp -d) || exit 2
+  trap 'rm -rf "$out"' EXIT
+fi
+
+cxx=${CXX:-g++}
+lib="$root/Fishduino.cpp $root/FishduinoMulti.cpp"
+lib="$lib $sim/SimArduino.cpp $sim/Sim30520.cpp"
+failed=""
+
+for src in "$check"/Check*.cpp; do
+  name=$(basename "$src" .cpp)
+  sketch=""
+
+  if [ "$name" = CheckSer ]; then
+    sketch="$out/Fishduino_Ser.cpp"
+    "$sim/ino2cpp.sh" "$root/Fishduino_Ser/Fishduino_Ser.ino" > "$sketch" || {
+      failed="$failed $name"
+      continue
+    }
+  fi
+
+  echo "=== $name"
+
+  if ! $cxx -std=gnu++11 -Wall -I "$sim" -I "$root" "$src" $sketch $lib \
+    -o "$out/$name"; then
+    echo "FAIL: $name doesn't build"
+    failed="$failed $name"
+    continue
+  fi
+
+  "$out/$name" || failed="$failed $name"
+done
+
+if [ -n "$failed" ]; then
+  echo "Failed:$failed"
+  exit 1
+fi
+
+echo "All checks passed"
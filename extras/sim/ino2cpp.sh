@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# Convert an Arduino sketch to a C++ source file, the way the Arduino IDE
+# does it before compiling: include Arduino.h, and declare the functions of
+# the sketch before the first line of code (after the comments and
+# #include lines at the top), so that they can be used before they're
+# defined.
+#
+# Only function definitions of which the name and parameters are on one
+# line are found; that's how the example sketches are written.
+#
+# Usage: ino2cpp.sh sketch.ino > sketch.cpp
+
+if [ $# -ne 1 ]; then
+  echo "Usage: $0 sketch.ino > sketch.cpp" >&2
+  exit 1
+fi
+
+awk -v sketch="$1" '
+  function isdef(line)
+  {
+    return (line ~ /^[A-Za-z_][A-Za-z0-9_ \t*&:<>,]*[ \t*&]+[A-Za-z_][A-Za-z0-9_]*[ \t]*\([^;]*\)[ \t]*(\{.*)?$/) &&
+      (line !~ /^(if|else|while|for|switch|return|do|case)[^A-Za-z0-9_]/)
+  }
+
+  # First pass: collect the prototypes and find the first line of code
+  NR == FNR {
+    line = $0
+
+    if (incomment)
+    {
+      if (sub(/^.*\*\//, "", line))
+      {
+        incomment = 0
+      }
+      else
+      {
+        next
+      }
+    }
+
+    if (line ~ /^[ \t]*\/\*/ && line !~ /\*\//)
+    {
+      incomment = 1
+      next
+    }
+
+    if ((!first) && (line !~ /^[ \t]*(#|\/\/|\/\*.*\*\/[ \t]*$|$)/))
+    {
+      first = FNR
+    }
+
+    if (isdef(line))
+    {
+      proto = line
+      sub(/[ \t]*\{.*$/, "", proto)
+      protos = protos proto ";\n"
+    }
+    next
+  }
+
+  # Second pass: copy the sketch, with the prototypes inserted
+  FNR == 1 {
+    print "#include <Arduino.h>"
+    printf "#line 1 \"%s\"\n", sketch
+  }
+
+  FNR == first {
+    printf "%s", protos
+    printf "#line %d \"%s\"\n", FNR, sketch
+  }
+
+  { print }
+' "$1" "$1"